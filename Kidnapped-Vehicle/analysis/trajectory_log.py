@@ -0,0 +1,89 @@
+"""Memory-mapped loader of the binary particle log (src/trajectory_log.h).
+
+Usage:
+    log = TrajectoryLog('parfiloutput/par_filter_log.bin')
+    step = log.step_header(10)     # step, num_particles, x, y, theta, weight
+    particles = log.particles(10)  # structured array with x, y, theta, weight
+    plt.scatter(particles['x'], particles['y'])
+"""
+
+import numpy as np
+
+LOG_MAGIC = b'PFTRAJ\r\n'
+INDEX_MAGIC = b'PFINDEX\n'
+LOG_VERSION = 1
+BYTE_ORDER = 0x01020304
+
+HEADER_DTYPE = np.dtype([('magic', 'S8'), ('version', '<u4'), ('byte_order', '<u4'),
+                         ('header_size', '<u4'), ('step_header_size', '<u4'),
+                         ('particle_size', '<u4'), ('reserved', '<u4')])
+STEP_HEADER_DTYPE = np.dtype([('step', '<u8'), ('num_particles', '<u8'), ('x', '<f8'),
+                              ('y', '<f8'), ('theta', '<f8'), ('weight', '<f8')])
+PARTICLE_DTYPE = np.dtype([('x', '<f8'), ('y', '<f8'), ('theta', '<f8'), ('weight', '<f8')])
+TRAILER_DTYPE = np.dtype([('index_offset', '<u8'), ('num_steps', '<u8'), ('magic', 'S8')])
+
+
+class TrajectoryLog(object):
+    """Particle log mapped into memory, with random access to the steps."""
+
+    def __init__(self, path):
+        self.data = np.memmap(path, dtype=np.uint8, mode='r')
+
+        header = self.data[:HEADER_DTYPE.itemsize].view(HEADER_DTYPE)[0]
+        if (header['magic'] != LOG_MAGIC or header['version'] != LOG_VERSION or
+                header['byte_order'] != BYTE_ORDER or
+                header['header_size'] != HEADER_DTYPE.itemsize or
+                header['step_header_size'] != STEP_HEADER_DTYPE.itemsize or
+                header['particle_size'] != PARTICLE_DTYPE.itemsize):
+            raise ValueError('%s is not a particle log of version %d' % (path, LOG_VERSION))
+
+        self.step_offsets = self._read_index()
+        if self.step_offsets is None:
+            self.step_offsets = self._scan_steps()
+
+    def __len__(self):
+        return len(self.step_offsets)
+
+    def step_header(self, index):
+        """Step, particle count and highest weighted pose of the index-th step."""
+        offset = int(self.step_offsets[index])
+        return self.data[offset:offset + STEP_HEADER_DTYPE.itemsize].view(STEP_HEADER_DTYPE)[0]
+
+    def particles(self, index):
+        """Particles of the index-th step, as a view into the mapped file."""
+        offset = int(self.step_offsets[index]) + STEP_HEADER_DTYPE.itemsize
+        count = int(self.step_header(index)['num_particles'])
+        return self.data[offset:offset + count * PARTICLE_DTYPE.itemsize].view(PARTICLE_DTYPE)
+
+    def poses(self):
+        """Highest weighted pose of every step, as arrays x, y and theta."""
+        headers = np.array([self.step_header(index) for index in range(len(self))],
+                           dtype=STEP_HEADER_DTYPE)
+        return headers['x'], headers['y'], headers['theta']
+
+    def _read_index(self):
+        # Index of a closed log, right before the trailer at the end
+        size = len(self.data)
+        if size < HEADER_DTYPE.itemsize + TRAILER_DTYPE.itemsize:
+            return None
+        index_end = size - TRAILER_DTYPE.itemsize
+        trailer = self.data[index_end:].view(TRAILER_DTYPE)[0]
+        index_offset = int(trailer['index_offset'])
+        if (trailer['magic'] != INDEX_MAGIC or index_offset > index_end or
+                (index_end - index_offset) != 8 * int(trailer['num_steps'])):
+            return None
+        return self.data[index_offset:index_end].view('<u8')
+
+    def _scan_steps(self):
+        # Walk the step headers of a log that was not closed
+        offsets = []
+        offset = HEADER_DTYPE.itemsize
+        size = len(self.data)
+        while offset + STEP_HEADER_DTYPE.itemsize <= size:
+            header = self.data[offset:offset + STEP_HEADER_DTYPE.itemsize].view(STEP_HEADER_DTYPE)[0]
+            end = offset + STEP_HEADER_DTYPE.itemsize + int(header['num_particles']) * PARTICLE_DTYPE.itemsize
+            if end > size:
+                break
+            offsets.append(offset)
+            offset = end
+        return np.array(offsets, dtype='<u8')
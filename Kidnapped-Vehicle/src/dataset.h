@@ -0,0 +1,294 @@
+/*
+ * dataset.h
+ *
+ * Packed binary form of a replay dataset: the map, the control measurements,
+ * the ground truth and the observations of every time step in one indexed
+ * file (written by pack_dataset). PackedDataset maps the file into memory and
+ * hands out the records in place, without opening or parsing anything per
+ * time step.
+ */
+
+#ifndef DATASET_H_
+#define DATASET_H_
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <string>
+
+#include "helper_functions.h"
+
+#define PACKED_DATASET_MAGIC "PFDATA\r\n"
+#define PACKED_DATASET_VERSION 1
+// Written in host byte order, so that a file from a host of the other byte
+// order is rejected
+#define PACKED_DATASET_BYTE_ORDER 0x01020304u
+// Sections start on cache line boundaries
+#define PACKED_DATASET_ALIGNMENT 64
+
+/*
+ * Header at the start of a packed dataset. The sections hold the records
+ * exactly as the structs lay them out in memory:
+ *   landmarks:    num_landmarks Map::single_landmark_s
+ *   controls:     num_controls control_s
+ *   ground_truth: num_ground_truth ground_truth
+ *   frame_index:  num_frames + 1 uint64_t, the observations of time step i
+ *                 are [frame_index[i], frame_index[i + 1])
+ *   observations: num_observations LandmarkObs
+ * Offsets are in bytes from the start of the file.
+ */
+struct PackedDatasetHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	// Record sizes, which have to match those of the reading build
+	uint32_t landmark_size;
+	uint32_t control_size;
+	uint32_t ground_truth_size;
+	uint32_t observation_size;
+	uint64_t num_landmarks;
+	uint64_t num_controls;
+	uint64_t num_ground_truth;
+	uint64_t num_frames;
+	uint64_t num_observations;
+	uint64_t landmarks_offset;
+	uint64_t controls_offset;
+	uint64_t ground_truth_offset;
+	uint64_t frame_index_offset;
+	uint64_t observations_offset;
+	uint64_t file_size;
+};
+
+// Rounds a file offset up to the alignment of the sections
+inline uint64_t packed_dataset_align(uint64_t offset)
+{
+	return (offset + PACKED_DATASET_ALIGNMENT - 1) & ~uint64_t(PACKED_DATASET_ALIGNMENT - 1);
+}
+
+/*
+ * Fills in a header for the given record counts, laying the sections out one
+ * after the other.
+ * @output header: Header with all fields set
+ */
+inline void packed_dataset_layout(uint64_t num_landmarks, uint64_t num_controls,
+																	uint64_t num_ground_truth, uint64_t num_frames,
+																	uint64_t num_observations, PackedDatasetHeader &header)
+{
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, PACKED_DATASET_MAGIC, sizeof(header.magic));
+	header.version = PACKED_DATASET_VERSION;
+	header.byte_order = PACKED_DATASET_BYTE_ORDER;
+	header.landmark_size = sizeof(Map::single_landmark_s);
+	header.control_size = sizeof(control_s);
+	header.ground_truth_size = sizeof(ground_truth);
+	header.observation_size = sizeof(LandmarkObs);
+	header.num_landmarks = num_landmarks;
+	header.num_controls = num_controls;
+	header.num_ground_truth = num_ground_truth;
+	header.num_frames = num_frames;
+	header.num_observations = num_observations;
+
+	header.landmarks_offset = packed_dataset_align(sizeof(header));
+	header.controls_offset = packed_dataset_align(header.landmarks_offset +
+																								num_landmarks * sizeof(Map::single_landmark_s));
+	header.ground_truth_offset = packed_dataset_align(header.controls_offset +
+																										num_controls * sizeof(control_s));
+	header.frame_index_offset = packed_dataset_align(header.ground_truth_offset +
+																									 num_ground_truth * sizeof(ground_truth));
+	header.observations_offset = packed_dataset_align(header.frame_index_offset +
+																										(num_frames + 1) * sizeof(uint64_t));
+	header.file_size = header.observations_offset + num_observations * sizeof(LandmarkObs);
+}
+
+/*
+ * Read-only, memory-mapped packed dataset. The spans it returns point into
+ * the mapping and stay valid until the dataset is closed or destroyed.
+ */
+class PackedDataset
+{
+public:
+	PackedDataset() : base(NULL), mapped_size(0) {}
+
+	~PackedDataset()
+	{
+		close();
+	}
+
+	PackedDataset(const PackedDataset &) = delete;
+	PackedDataset &operator=(const PackedDataset &) = delete;
+
+	/*
+	 * Maps a packed dataset and checks its header and frame index.
+	 * @param filename: Name of the packed dataset file
+	 * @output True if the file could be mapped and is a valid dataset
+	 */
+	bool open(const std::string &filename)
+	{
+		close();
+
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd < 0)
+		{
+			return false;
+		}
+		struct stat file_stat;
+		if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < sizeof(PackedDatasetHeader))
+		{
+			::close(fd);
+			return false;
+		}
+
+		mapped_size = size_t(file_stat.st_size);
+		void *mapping = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		// The mapping keeps the file referenced on its own
+		::close(fd);
+		if (mapping == MAP_FAILED)
+		{
+			mapped_size = 0;
+			return false;
+		}
+		base = static_cast<const char*>(mapping);
+
+		// Replay runs walk the frames front to back, so read ahead
+		madvise(mapping, mapped_size, MADV_SEQUENTIAL);
+
+		if (!validate())
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	// Unmaps the dataset, invalidating all spans handed out
+	void close()
+	{
+		if (base != NULL)
+		{
+			munmap(const_cast<char*>(base), mapped_size);
+			base = NULL;
+			mapped_size = 0;
+		}
+	}
+
+	bool isOpen() const
+	{
+		return base != NULL;
+	}
+
+	ConstSpan<Map::single_landmark_s> landmarks() const
+	{
+		return ConstSpan<Map::single_landmark_s>(section<Map::single_landmark_s>(header().landmarks_offset),
+																						 header().num_landmarks);
+	}
+
+	ConstSpan<control_s> controls() const
+	{
+		return ConstSpan<control_s>(section<control_s>(header().controls_offset),
+																header().num_controls);
+	}
+
+	ConstSpan<ground_truth> groundTruth() const
+	{
+		return ConstSpan<ground_truth>(section<ground_truth>(header().ground_truth_offset),
+																	 header().num_ground_truth);
+	}
+
+	// Number of time steps with an observation frame
+	size_t numFrames() const
+	{
+		return header().num_frames;
+	}
+
+	/*
+	 * Observations of a time step, in the order of the original file.
+	 * @param frame: Time step, in [0, numFrames())
+	 */
+	ConstSpan<LandmarkObs> observations(size_t frame) const
+	{
+		const uint64_t *frame_index = section<uint64_t>(header().frame_index_offset);
+		const LandmarkObs *first = section<LandmarkObs>(header().observations_offset);
+		return ConstSpan<LandmarkObs>(first + frame_index[frame],
+																	frame_index[frame + 1] - frame_index[frame]);
+	}
+
+	/*
+	 * Copies the landmarks into a map, which keeps them in its own list for
+	 * indexing.
+	 * @output map: Map with the landmarks appended to landmark_list
+	 */
+	void loadMap(Map &map) const
+	{
+		ConstSpan<Map::single_landmark_s> list = landmarks();
+		map.landmark_list.insert(map.landmark_list.end(), list.begin(), list.end());
+	}
+
+private:
+	const char *base;
+	size_t mapped_size;
+
+	const PackedDatasetHeader &header() const
+	{
+		return *reinterpret_cast<const PackedDatasetHeader*>(base);
+	}
+
+	template <typename T>
+	const T *section(uint64_t offset) const
+	{
+		return reinterpret_cast<const T*>(base + offset);
+	}
+
+	// Checks that a section of count records of the given size lies in the file
+	bool sectionFits(uint64_t offset, uint64_t count, uint64_t record_size) const
+	{
+		return offset % PACKED_DATASET_ALIGNMENT == 0 && offset <= mapped_size &&
+					 count <= (mapped_size - offset) / record_size;
+	}
+
+	bool validate() const
+	{
+		const PackedDatasetHeader &head = header();
+		if (memcmp(head.magic, PACKED_DATASET_MAGIC, sizeof(head.magic)) != 0 ||
+				head.version != PACKED_DATASET_VERSION ||
+				head.byte_order != PACKED_DATASET_BYTE_ORDER ||
+				head.landmark_size != sizeof(Map::single_landmark_s) ||
+				head.control_size != sizeof(control_s) ||
+				head.ground_truth_size != sizeof(ground_truth) ||
+				head.observation_size != sizeof(LandmarkObs) ||
+				head.file_size != mapped_size)
+		{
+			return false;
+		}
+
+		if (!sectionFits(head.landmarks_offset, head.num_landmarks, sizeof(Map::single_landmark_s)) ||
+				!sectionFits(head.controls_offset, head.num_controls, sizeof(control_s)) ||
+				!sectionFits(head.ground_truth_offset, head.num_ground_truth, sizeof(ground_truth)) ||
+				head.num_frames >= mapped_size ||
+				!sectionFits(head.frame_index_offset, head.num_frames + 1, sizeof(uint64_t)) ||
+				!sectionFits(head.observations_offset, head.num_observations, sizeof(LandmarkObs)))
+		{
+			return false;
+		}
+
+		// The frames have to cover the observations in order
+		const uint64_t *frame_index = section<uint64_t>(head.frame_index_offset);
+		if (frame_index[0] != 0 || frame_index[head.num_frames] != head.num_observations)
+		{
+			return false;
+		}
+		for (uint64_t frame = 0; frame < head.num_frames; frame++)
+		{
+			if (frame_index[frame] > frame_index[frame + 1])
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+};
+
+#endif /* DATASET_H_ */
@@ -0,0 +1,322 @@
+#include <math.h>
+
+#include "filter_kernels.h"
+#include "simd_math.h"
+
+#if PF_SIMD_WIDTH > 1
+// Box-Muller transform of the Philox numbers of a block of PF_SIMD_WIDTH
+// particles, as CounterRng::normal2 computes them
+static void simd_standard_normals(const uint32_t key[2], RandomStream stream, uint64_t step,
+																	size_t first_index, uint32_t block,
+																	simd_double *n0, simd_double *n1)
+{
+	uint32_t words[4];
+	CounterRng::counterWords(stream, step, 0, block, words);
+
+	simd_uint64 counter[4];
+	counter[0] = simd_u64_and(simd_u64_sequence(first_index), simd_u64_set1(0xFFFFFFFFu));
+	counter[1] = simd_u64_set1(words[1]);
+	counter[2] = simd_u64_set1(words[2]);
+	counter[3] = simd_u64_set1(words[3]);
+	simd_philox4x32_10(counter, key[0], key[1]);
+
+	simd_double u0 = simd_philox_uniform(counter[0], counter[1]);
+	simd_double u1 = simd_philox_uniform(counter[2], counter[3]);
+
+	// 1 - u0 lies in (0, 1], so the logarithm stays finite
+	simd_double radius = simd_sqrt(simd_mul(simd_set1(-2.0),
+																					simd_log(simd_sub(simd_set1(1.0), u0))));
+	simd_double sin_angle, cos_angle;
+	simd_sincos(simd_mul(simd_set1(2.0 * M_PI), u1), &sin_angle, &cos_angle);
+	*n0 = simd_mul(radius, cos_angle);
+	*n1 = simd_mul(radius, sin_angle);
+}
+#endif
+
+// Gaussian noise of a range of particles
+void gaussian_noise(const CounterRng &rng, RandomStream stream, uint64_t step,
+										size_t first_index, size_t count,
+										double std_x, double std_y, double std_theta,
+										double *noise_x, double *noise_y, double *noise_theta)
+{
+	size_t par_index = 0;
+
+#if PF_SIMD_WIDTH > 1
+	simd_double v_std_x = simd_set1(std_x);
+	simd_double v_std_y = simd_set1(std_y);
+	simd_double v_std_theta = simd_set1(std_theta);
+
+	for(; par_index + PF_SIMD_WIDTH <= count; par_index += PF_SIMD_WIDTH)
+	{
+		simd_double n0, n1, n2, unused;
+		simd_standard_normals(rng.keyWords(), stream, step, first_index + par_index, 0, &n0, &n1);
+		simd_standard_normals(rng.keyWords(), stream, step, first_index + par_index, 1, &n2, &unused);
+
+		simd_store(noise_x + par_index, simd_mul(n0, v_std_x));
+		simd_store(noise_y + par_index, simd_mul(n1, v_std_y));
+		simd_store(noise_theta + par_index, simd_mul(n2, v_std_theta));
+	}
+#endif
+
+	for(; par_index < count; par_index++)
+	{
+		double n0, n1, n2, unused;
+		uint32_t index = uint32_t(first_index + par_index);
+		rng.normal2(stream, step, index, 0, &n0, &n1);
+		rng.normal2(stream, step, index, 1, &n2, &unused);
+
+		noise_x[par_index] = n0 * std_x;
+		noise_y[par_index] = n1 * std_y;
+		noise_theta[par_index] = n2 * std_theta;
+	}
+}
+
+#if PF_SIMD_WIDTH > 1
+// Rotates cached headings (cos, sin) by per-particle angles, optionally
+// pulling them back onto the unit circle
+static inline void simd_rotate_heading(simd_double angle, bool renormalize,
+																			 simd_double *cos_theta, simd_double *sin_theta)
+{
+	simd_double sin_angle, cos_angle;
+	simd_sincos(angle, &sin_angle, &cos_angle);
+
+	simd_double new_cos = simd_sub(simd_mul(*cos_theta, cos_angle), simd_mul(*sin_theta, sin_angle));
+	simd_double new_sin = simd_fmadd(*sin_theta, cos_angle, simd_mul(*cos_theta, sin_angle));
+
+	if(renormalize)
+	{
+		// One Newton step towards 1 / |(cos, sin)|, enough for the rounding
+		// drift of a few steps
+		simd_double norm_sq = simd_fmadd(new_cos, new_cos, simd_mul(new_sin, new_sin));
+		simd_double scale = simd_fmadd(norm_sq, simd_set1(-0.5), simd_set1(1.5));
+		new_cos = simd_mul(new_cos, scale);
+		new_sin = simd_mul(new_sin, scale);
+	}
+
+	*cos_theta = new_cos;
+	*sin_theta = new_sin;
+}
+#endif
+
+// Scalar counterpart of simd_rotate_heading
+static inline void rotate_heading(double angle, bool renormalize,
+																	double *cos_theta, double *sin_theta)
+{
+	double sin_angle = sin(angle);
+	double cos_angle = cos(angle);
+
+	double new_cos = *cos_theta * cos_angle - *sin_theta * sin_angle;
+	double new_sin = *sin_theta * cos_angle + *cos_theta * sin_angle;
+
+	if(renormalize)
+	{
+		double scale = 1.5 - 0.5 * (new_cos * new_cos + new_sin * new_sin);
+		new_cos *= scale;
+		new_sin *= scale;
+	}
+
+	*cos_theta = new_cos;
+	*sin_theta = new_sin;
+}
+
+// CTRV motion update for a non-zero yaw rate
+void predict_turning(double *x, double *y, double *theta,
+										 double *cos_theta, double *sin_theta,
+										 const double *noise_x, const double *noise_y,
+										 const double *noise_theta, size_t count,
+										 double velocity, double yaw_rate, double delta_t,
+										 bool renormalize)
+{
+	double radius = velocity / yaw_rate;
+	double delta_theta = yaw_rate * delta_t;
+	// The turn is the same for every particle, so its trigonometry is too
+	double cos_delta = cos(delta_theta);
+	double sin_delta = sin(delta_theta);
+	size_t par_index = 0;
+
+#if PF_SIMD_WIDTH > 1
+	simd_double v_radius = simd_set1(radius);
+	simd_double v_delta_theta = simd_set1(delta_theta);
+	simd_double v_cos_delta = simd_set1(cos_delta);
+	simd_double v_sin_delta = simd_set1(sin_delta);
+
+	for(; par_index + PF_SIMD_WIDTH <= count; par_index += PF_SIMD_WIDTH)
+	{
+		simd_double cos_prev = simd_load(cos_theta + par_index);
+		simd_double sin_prev = simd_load(sin_theta + par_index);
+
+		// Angle addition for theta + w * dt
+		simd_double cos_new = simd_sub(simd_mul(cos_prev, v_cos_delta),
+																	 simd_mul(sin_prev, v_sin_delta));
+		simd_double sin_new = simd_fmadd(sin_prev, v_cos_delta, simd_mul(cos_prev, v_sin_delta));
+
+		// x += r * (sin(theta + w * dt) - sin(theta)) + noise
+		simd_double new_x = simd_fmadd(v_radius, simd_sub(sin_new, sin_prev),
+																	 simd_load(x + par_index));
+		// y += r * (cos(theta) - cos(theta + w * dt)) + noise
+		simd_double new_y = simd_fmadd(v_radius, simd_sub(cos_prev, cos_new),
+																	 simd_load(y + par_index));
+
+		simd_double v_noise_theta = simd_load(noise_theta + par_index);
+		simd_store(x + par_index, simd_add(new_x, simd_load(noise_x + par_index)));
+		simd_store(y + par_index, simd_add(new_y, simd_load(noise_y + par_index)));
+		simd_store(theta + par_index,
+							 simd_add(simd_add(simd_load(theta + par_index), v_delta_theta), v_noise_theta));
+
+		// The cached heading follows the heading noise
+		simd_rotate_heading(v_noise_theta, renormalize, &cos_new, &sin_new);
+		simd_store(cos_theta + par_index, cos_new);
+		simd_store(sin_theta + par_index, sin_new);
+	}
+#endif
+
+	for(; par_index < count; par_index++)
+	{
+		double cos_prev = cos_theta[par_index];
+		double sin_prev = sin_theta[par_index];
+		double cos_new = cos_prev * cos_delta - sin_prev * sin_delta;
+		double sin_new = sin_prev * cos_delta + cos_prev * sin_delta;
+
+		x[par_index] += radius * (sin_new - sin_prev) + noise_x[par_index];
+		y[par_index] += radius * (cos_prev - cos_new) + noise_y[par_index];
+		theta[par_index] += delta_theta + noise_theta[par_index];
+
+		rotate_heading(noise_theta[par_index], renormalize, &cos_new, &sin_new);
+		cos_theta[par_index] = cos_new;
+		sin_theta[par_index] = sin_new;
+	}
+}
+
+// Straight line motion update
+void predict_straight(double *x, double *y, double *theta,
+											double *cos_theta, double *sin_theta,
+											const double *noise_x, const double *noise_y,
+											const double *noise_theta, size_t count,
+											double velocity, double yaw_rate, double delta_t,
+											bool renormalize)
+{
+	double distance = velocity * delta_t;
+	double delta_theta = yaw_rate * delta_t;
+	size_t par_index = 0;
+
+#if PF_SIMD_WIDTH > 1
+	simd_double v_distance = simd_set1(distance);
+	simd_double v_delta_theta = simd_set1(delta_theta);
+
+	for(; par_index + PF_SIMD_WIDTH <= count; par_index += PF_SIMD_WIDTH)
+	{
+		simd_double cos_prev = simd_load(cos_theta + par_index);
+		simd_double sin_prev = simd_load(sin_theta + par_index);
+
+		simd_double new_x = simd_fmadd(v_distance, cos_prev, simd_load(x + par_index));
+		simd_double new_y = simd_fmadd(v_distance, sin_prev, simd_load(y + par_index));
+		simd_double rotation = simd_add(v_delta_theta, simd_load(noise_theta + par_index));
+
+		simd_store(x + par_index, simd_add(new_x, simd_load(noise_x + par_index)));
+		simd_store(y + par_index, simd_add(new_y, simd_load(noise_y + par_index)));
+		simd_store(theta + par_index, simd_add(simd_load(theta + par_index), rotation));
+
+		simd_rotate_heading(rotation, renormalize, &cos_prev, &sin_prev);
+		simd_store(cos_theta + par_index, cos_prev);
+		simd_store(sin_theta + par_index, sin_prev);
+	}
+#endif
+
+	for(; par_index < count; par_index++)
+	{
+		double rotation = delta_theta + noise_theta[par_index];
+
+		x[par_index] += distance * cos_theta[par_index] + noise_x[par_index];
+		y[par_index] += distance * sin_theta[par_index] + noise_y[par_index];
+		theta[par_index] += rotation;
+
+		rotate_heading(rotation, renormalize, &cos_theta[par_index], &sin_theta[par_index]);
+	}
+}
+
+// Log weight plus the bivariate Gaussian log likelihoods of all observations
+void observation_log_likelihood(const double *residual_x, const double *residual_y,
+																size_t count, size_t stride, size_t num_obs,
+																double std_x, double std_y, double *log_weight)
+{
+	// Factors of the squared Mahalanobis distance and the log of the
+	// normalizer for all observations together
+	double scale_x = 1.0 / (2.0 * std_x * std_x);
+	double scale_y = 1.0 / (2.0 * std_y * std_y);
+	double log_norm = -double(num_obs) * log(2.0 * M_PI * std_x * std_y);
+	size_t par_index = 0;
+
+#if PF_SIMD_WIDTH > 1
+	simd_double v_scale_x = simd_set1(scale_x);
+	simd_double v_scale_y = simd_set1(scale_y);
+	simd_double v_log_norm = simd_set1(log_norm);
+
+	for(; par_index + PF_SIMD_WIDTH <= count; par_index += PF_SIMD_WIDTH)
+	{
+		simd_double sum_x = simd_set1(0.0);
+		simd_double sum_y = simd_set1(0.0);
+		for(size_t obs_index = 0; obs_index < num_obs; obs_index++)
+		{
+			simd_double dx = simd_load(residual_x + obs_index * stride + par_index);
+			simd_double dy = simd_load(residual_y + obs_index * stride + par_index);
+			sum_x = simd_fmadd(dx, dx, sum_x);
+			sum_y = simd_fmadd(dy, dy, sum_y);
+		}
+
+		simd_double exponent = simd_fmadd(sum_x, v_scale_x, simd_mul(sum_y, v_scale_y));
+		simd_double log_likelihood = simd_sub(v_log_norm, exponent);
+		simd_store(log_weight + par_index,
+							 simd_add(simd_load(log_weight + par_index), log_likelihood));
+	}
+#endif
+
+	for(; par_index < count; par_index++)
+	{
+		double sum_x = 0.0;
+		double sum_y = 0.0;
+		for(size_t obs_index = 0; obs_index < num_obs; obs_index++)
+		{
+			double dx = residual_x[obs_index * stride + par_index];
+			double dy = residual_y[obs_index * stride + par_index];
+			sum_x += dx * dx;
+			sum_y += dy * dy;
+		}
+
+		log_weight[par_index] += log_norm - (sum_x * scale_x + sum_y * scale_y);
+	}
+}
+
+// Weights relative to a reference log weight
+double exp_weights(const double *log_weight, size_t count, double log_reference,
+									 double *weight)
+{
+	double sum = 0.0;
+	size_t par_index = 0;
+
+#if PF_SIMD_WIDTH > 1
+	simd_double v_log_reference = simd_set1(log_reference);
+	simd_double v_sum = simd_set1(0.0);
+
+	for(; par_index + PF_SIMD_WIDTH <= count; par_index += PF_SIMD_WIDTH)
+	{
+		simd_double value = simd_exp(simd_sub(simd_load(log_weight + par_index), v_log_reference));
+		simd_store(weight + par_index, value);
+		v_sum = simd_add(v_sum, value);
+	}
+
+	double lane_sums[PF_SIMD_WIDTH];
+	simd_store(lane_sums, v_sum);
+	for(size_t lane = 0; lane < PF_SIMD_WIDTH; lane++)
+	{
+		sum += lane_sums[lane];
+	}
+#endif
+
+	for(; par_index < count; par_index++)
+	{
+		weight[par_index] = exp(log_weight[par_index] - log_reference);
+		sum += weight[par_index];
+	}
+
+	return sum;
+}
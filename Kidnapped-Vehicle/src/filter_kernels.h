@@ -0,0 +1,101 @@
+/*
+ * filter_kernels.h
+ *
+ * Data parallel kernels of the particle filter stages. Every kernel works on
+ * the plain arrays of a ParticleSet (or a sub-range of them) and has a SIMD
+ * path plus a scalar loop for the remainder and for builds without AVX2.
+ */
+
+#ifndef FILTER_KERNELS_H_
+#define FILTER_KERNELS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "philox.h"
+
+/*
+ * Fills noise arrays with Gaussian noise for the particles
+ * [first_index, first_index + count): the Box-Muller transform of the
+ * numbers of block 0 of a particle gives its x and y noise, of block 1 its
+ * theta noise (see CounterRng). Philox and Box-Muller run on a whole SIMD
+ * register of particles at a time.
+ * @param rng: Seeded generator
+ * @param stream, step: Stream and time step to draw from
+ * @param first_index: Index of the first particle
+ * @param count: Number of particles
+ * @param std_x, std_y, std_theta: Standard deviations of the noise
+ * @output noise_x, noise_y, noise_theta: Noise arrays of length count
+ */
+void gaussian_noise(const CounterRng &rng, RandomStream stream, uint64_t step,
+										size_t first_index, size_t count,
+										double std_x, double std_y, double std_theta,
+										double *noise_x, double *noise_y, double *noise_theta);
+
+/*
+ * CTRV motion update for a non-zero yaw rate, plus pre-generated noise.
+ * The motion model works on the cached cosine and sine of the headings, which
+ * follow the turn by angle addition, so only the heading noise needs sin/cos.
+ * @param x, y, theta: Particle state arrays of length count, updated in place
+ * @param cos_theta, sin_theta: Cached cos(theta) and sin(theta), updated in
+ *   place
+ * @param noise_x, noise_y, noise_theta: Gaussian noise to add to each particle
+ * @param count: Number of particles
+ * @param velocity: Velocity of car from t to t+1 [m/s]
+ * @param yaw_rate: Yaw rate of car from t to t+1 [rad/s]
+ * @param delta_t: Time between time step t and t+1 [s]
+ * @param renormalize: Whether to pull the cached (cos, sin) pairs back onto
+ *   the unit circle, which rounding slowly moves them off
+ */
+void predict_turning(double *x, double *y, double *theta,
+										 double *cos_theta, double *sin_theta,
+										 const double *noise_x, const double *noise_y,
+										 const double *noise_theta, size_t count,
+										 double velocity, double yaw_rate, double delta_t,
+										 bool renormalize);
+
+/*
+ * Straight line motion update (yaw rate close to zero), plus pre-generated
+ * noise. Parameters as for predict_turning.
+ */
+void predict_straight(double *x, double *y, double *theta,
+											double *cos_theta, double *sin_theta,
+											const double *noise_x, const double *noise_y,
+											const double *noise_theta, size_t count,
+											double velocity, double yaw_rate, double delta_t,
+											bool renormalize);
+
+/*
+ * Adds the log likelihood of the associated observations of every particle
+ * under the bivariate Gaussian landmark measurement model to its log weight.
+ * The exponents of all observations are summed, with the Gaussian normalizer
+ * folded into a single constant.
+ * @param residual_x, residual_y: Difference between associated landmark and
+ *   observation in map coordinates [m], observation-major: the residual of
+ *   observation o for particle p is at index o * stride + p
+ * @param count: Number of particles
+ * @param stride: Distance between the rows of the residual arrays, at least
+ *   count (larger when the kernel processes a sub-range of the particles)
+ * @param num_obs: Number of observations per particle
+ * @param std_x, std_y: Standard deviation of the landmark measurement [m]
+ * @param log_weight: Log weight of each particle (array of length count),
+ *   updated in place
+ */
+void observation_log_likelihood(const double *residual_x, const double *residual_y,
+																size_t count, size_t stride, size_t num_obs,
+																double std_x, double std_y, double *log_weight);
+
+/*
+ * Turns log weights into weights relative to a reference log weight,
+ * weight = exp(log_weight - log_reference). With the highest log weight as
+ * reference the weights lie in (0, 1] and cannot all underflow.
+ * @param log_weight: Log weight of each particle (array of length count)
+ * @param count: Number of particles
+ * @param log_reference: Log weight that maps to a weight of 1
+ * @output weight: Weight of each particle (array of length count)
+ * @output Sum of the weights
+ */
+double exp_weights(const double *log_weight, size_t count, double log_reference,
+									 double *weight);
+
+#endif /* FILTER_KERNELS_H_ */
@@ -13,6 +13,7 @@
 #include <math.h>
 #include <vector>
 #include "map.h"
+#include "text_parser.h"
 
 // For general debugging
 #define DEBUG 0
@@ -21,6 +22,16 @@
 // using the output for visualization
 #define WRITE_PAR_FIL_OUTPUT 1
 
+// Enable this flag to compress the particles output into a single archive
+// (see snapshot_codec.h, unpack_snapshots expands it) instead of one text
+// file per time step, keeping positions to within PAR_FIL_OUTPUT_ERROR [m]
+#define COMPRESS_PAR_FIL_OUTPUT 0
+#define PAR_FIL_OUTPUT_ERROR 0.01
+
+// Enable this flag to log the particles of all time steps into a single
+// binary file (see trajectory_log.h) for analysis
+#define WRITE_PAR_FIL_LOG 0
+
 // Struct representing one position/control measurement.
 struct control_s
 {
@@ -52,6 +63,28 @@ struct LandmarkObs
 	double y;
 };
 
+// Read-only view of a contiguous array of elements (e.g. observations) that
+// does not own or copy them. Converts implicitly from a vector.
+template <typename T>
+class ConstSpan
+{
+public:
+	ConstSpan() : ptr(NULL), len(0) {}
+	ConstSpan(const T *data, size_t size) : ptr(data), len(size) {}
+	ConstSpan(const std::vector<T> &vec) : ptr(vec.empty() ? NULL : &vec[0]), len(vec.size()) {}
+
+	const T *data() const { return ptr; }
+	size_t size() const { return len; }
+	bool empty() const { return len == 0; }
+	const T *begin() const { return ptr; }
+	const T *end() const { return ptr + len; }
+	const T &operator[](size_t index) const { return ptr[index]; }
+
+private:
+	const T *ptr;
+	size_t len;
+};
+
 /*
  * Computes the Euclidean distance between two 2D points.
  * @param (x1, y1) x and y coordinates of first point
@@ -91,38 +124,30 @@ inline double * getError(double gt_x, double gt_y, double gt_theta, double pf_x,
 inline bool read_map_data(std::string filename, Map& map)
 {
 	// Get file of map:
-	std::ifstream in_file_map(filename.c_str(),std::ifstream::in);
+	TextFileParser in_file_map;
 
 	// Return if we can't open the file.
-	if (!in_file_map)
+	if (!in_file_map.open(filename))
 	{
 		return false;
 	}
 
-	// Declare single line of map file:
-	std::string line_map;
+	// At most one landmark per line:
+	map.landmark_list.reserve(map.landmark_list.size() + in_file_map.numLines());
 
 	// Run over each single line:
-	while(getline(in_file_map, line_map))
+	while (in_file_map.nextLine())
 	{
-		std::istringstream iss_map(line_map);
-
-		// Declare landmark values and ID:
-		float landmark_x_f, landmark_y_f;
-		int id_i;
-
-		// Read data from current line to values::
-		iss_map >> landmark_x_f;
-		iss_map >> landmark_y_f;
-		iss_map >> id_i;
-
 		// Declare single_landmark:
 		Map::single_landmark_s single_landmark_temp;
 
-		// Set values
-		single_landmark_temp.id_i = id_i;
-		single_landmark_temp.x_f  = landmark_x_f;
-		single_landmark_temp.y_f  = landmark_y_f;
+		// Read data from current line to values:
+		if (!in_file_map.field(single_landmark_temp.x_f) ||
+				!in_file_map.field(single_landmark_temp.y_f) ||
+				!in_file_map.field(single_landmark_temp.id_i))
+		{
+			return in_file_map.error("landmark x, y and id");
+		}
 
 		// Add to landmark list of map:
 		map.landmark_list.push_back(single_landmark_temp);
@@ -138,35 +163,28 @@ inline bool read_map_data(std::string filename, Map& map)
 inline bool read_control_data(std::string filename, std::vector<control_s>& position_meas)
 {
 	// Get file of position measurements:
-	std::ifstream in_file_pos(filename.c_str(),std::ifstream::in);
+	TextFileParser in_file_pos;
 
 	// Return if we can't open the file.
-	if (!in_file_pos)
+	if (!in_file_pos.open(filename))
 	{
 		return false;
 	}
 
-	// Declare single line of position measurement file:
-	std::string line_pos;
+	// At most one measurement per line:
+	position_meas.reserve(position_meas.size() + in_file_pos.numLines());
 
 	// Run over each single line:
-	while(getline(in_file_pos, line_pos))
+	while (in_file_pos.nextLine())
 	{
-		std::istringstream iss_pos(line_pos);
-
-		// Declare position values:
-		double velocity, yawrate;
-
 		// Declare single control measurement:
 		control_s meas;
 
 		// Read data from line to values:
-		iss_pos >> velocity;
-		iss_pos >> yawrate;
-
-		// Set values
-		meas.velocity = velocity;
-		meas.yawrate = yawrate;
+		if (!in_file_pos.field(meas.velocity) || !in_file_pos.field(meas.yawrate))
+		{
+			return in_file_pos.error("velocity and yaw rate");
+		}
 
 		// Add to list of control measurements:
 		position_meas.push_back(meas);
@@ -182,39 +200,31 @@ inline bool read_control_data(std::string filename, std::vector<control_s>& posi
 inline bool read_gt_data(std::string filename, std::vector<ground_truth>& gt)
 {
 	// Get file of position measurements:
-	std::ifstream in_file_pos(filename.c_str(),std::ifstream::in);
+	TextFileParser in_file_pos;
 
 	// Return if we can't open the file.
-	if (!in_file_pos)
+	if (!in_file_pos.open(filename))
 	{
 		return false;
 	}
 
-	// Declare single line of position measurement file:
-	std::string line_pos;
+	// At most one position per line:
+	gt.reserve(gt.size() + in_file_pos.numLines());
 
 	// Run over each single line:
-	while(getline(in_file_pos, line_pos))
+	while (in_file_pos.nextLine())
 	{
-		std::istringstream iss_pos(line_pos);
-
-		// Declare position values:
-		double x, y, azimuth;
-
 		// Declare single ground truth:
 		ground_truth single_gt;
 
 		// Read data from line to values:
-		iss_pos >> x;
-		iss_pos >> y;
-		iss_pos >> azimuth;
+		if (!in_file_pos.field(single_gt.x) || !in_file_pos.field(single_gt.y) ||
+				!in_file_pos.field(single_gt.theta))
+		{
+			return in_file_pos.error("x, y and azimuth");
+		}
 
-		// Set values
-		single_gt.x = x;
-		single_gt.y = y;
-		single_gt.theta = azimuth;
-
-		// Add to list of control measurements and ground truth:
+		// Add to list of ground truth positions:
 		gt.push_back(single_gt);
 	}
 
@@ -228,37 +238,30 @@ inline bool read_gt_data(std::string filename, std::vector<ground_truth>& gt)
 inline bool read_landmark_data(std::string filename, std::vector<LandmarkObs>& observations)
 {
 	// Get file of landmark measurements:
-	std::ifstream in_file_obs(filename.c_str(),std::ifstream::in);
+	TextFileParser in_file_obs;
 
 	// Return if we can't open the file.
-	if (!in_file_obs)
+	if (!in_file_obs.open(filename))
 	{
 		return false;
 	}
 
-	// Declare single line of landmark measurement file:
-	std::string line_obs;
+	// At most one measurement per line:
+	observations.reserve(observations.size() + in_file_obs.numLines());
 
 	// Run over each single line:
-	while(getline(in_file_obs, line_obs))
+	while (in_file_obs.nextLine())
 	{
-		std::istringstream iss_obs(line_obs);
-
-		// Declare position values:
-		double local_x, local_y;
-
-		// Read data from line to values:
-		iss_obs >> local_x;
-		iss_obs >> local_y;
-
 		// Declare single landmark measurement:
 		LandmarkObs meas;
 
-		// Set values
-		meas.x = local_x;
-		meas.y = local_y;
+		// Read data from line to values:
+		if (!in_file_obs.field(meas.x) || !in_file_obs.field(meas.y))
+		{
+			return in_file_obs.error("local x and y");
+		}
 
-		// Add to list of control measurements:
+		// Add to list of landmark measurements:
 		observations.push_back(meas);
 	}
 
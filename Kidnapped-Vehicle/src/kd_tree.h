@@ -0,0 +1,168 @@
+/*
+ * kd_tree.h
+ *
+ * Static 2-D k-d tree for nearest neighbour queries over map landmarks.
+ */
+
+#ifndef KD_TREE_H_
+#define KD_TREE_H_
+
+#include <float.h>
+#include <algorithm>
+#include <vector>
+
+class LandmarkKdTree
+{
+public:
+	/*
+	 * Builds the tree over a list of landmarks. The tree keeps its own copy of
+	 * the positions, so it stays valid when the list is modified.
+	 * @param landmarks: Landmarks with x_f and y_f positions, e.g.
+	 *   Map::landmark_list
+	 */
+	template <typename Landmark>
+	void build(const std::vector<Landmark> &landmarks)
+	{
+		nodes.resize(landmarks.size());
+		for (size_t index = 0; index < landmarks.size(); index++)
+		{
+			nodes[index].x = landmarks[index].x_f;
+			nodes[index].y = landmarks[index].y_f;
+			nodes[index].index = int(index);
+		}
+		buildRange(0, nodes.size(), 0);
+	}
+
+	bool empty() const
+	{
+		return nodes.empty();
+	}
+
+	/*
+	 * Finds the landmark closest to (x, y).
+	 * @output index: Index of the nearest landmark in the list passed to build()
+	 * @output dist_sq: Squared distance to the nearest landmark
+	 * @output True if the tree is not empty
+	 */
+	bool nearest(double x, double y, int *index, double *dist_sq) const
+	{
+		return nearestWithin(x, y, 0.0, 0.0, DBL_MAX, index, dist_sq);
+	}
+
+	/*
+	 * Finds the landmark closest to (x, y) among the landmarks within a given
+	 * radius of a center point, e.g. the landmarks in sensor range of a
+	 * particle.
+	 * @param (x, y): Query point
+	 * @param (center_x, center_y), radius: Circle the result has to lie in
+	 * @output index: Index of the nearest landmark in the list passed to build()
+	 * @output dist_sq: Squared distance to the nearest landmark
+	 * @output True if a landmark was found inside the circle
+	 */
+	bool nearestWithin(double x, double y, double center_x, double center_y,
+										 double radius, int *index, double *dist_sq) const
+	{
+		Query query;
+		query.x = x;
+		query.y = y;
+		query.center_x = center_x;
+		query.center_y = center_y;
+		query.radius_sq = radius == DBL_MAX ? DBL_MAX : radius * radius;
+		query.best_dist_sq = DBL_MAX;
+		query.best_index = -1;
+
+		searchRange(query, 0, nodes.size(), 0);
+
+		*index = query.best_index;
+		*dist_sq = query.best_dist_sq;
+		return query.best_index >= 0;
+	}
+
+private:
+	struct Node
+	{
+		float x;
+		float y;
+		// Index of the landmark in the list passed to build()
+		int index;
+	};
+
+	struct Query
+	{
+		double x;
+		double y;
+		double center_x;
+		double center_y;
+		double radius_sq;
+		double best_dist_sq;
+		int best_index;
+	};
+
+	// Landmarks in tree order: the median of every range splits it, on x at even
+	// and on y at odd depths
+	std::vector<Node> nodes;
+
+	static bool lessX(const Node &a, const Node &b) { return a.x < b.x; }
+	static bool lessY(const Node &a, const Node &b) { return a.y < b.y; }
+
+	void buildRange(size_t begin, size_t end, int depth)
+	{
+		if (end - begin <= 1)
+		{
+			return;
+		}
+
+		size_t mid = begin + (end - begin) / 2;
+		std::nth_element(nodes.begin() + begin, nodes.begin() + mid, nodes.begin() + end,
+										 depth % 2 == 0 ? lessX : lessY);
+		buildRange(begin, mid, depth + 1);
+		buildRange(mid + 1, end, depth + 1);
+	}
+
+	void searchRange(Query &query, size_t begin, size_t end, int depth) const
+	{
+		if (begin >= end)
+		{
+			return;
+		}
+
+		size_t mid = begin + (end - begin) / 2;
+		const Node &node = nodes[mid];
+
+		double dx = node.x - query.x;
+		double dy = node.y - query.y;
+		double dist_sq = dx * dx + dy * dy;
+		if (dist_sq < query.best_dist_sq)
+		{
+			double cx = node.x - query.center_x;
+			double cy = node.y - query.center_y;
+			if (query.radius_sq == DBL_MAX || cx * cx + cy * cy <= query.radius_sq)
+			{
+				query.best_dist_sq = dist_sq;
+				query.best_index = node.index;
+			}
+		}
+
+		// Search the side of the split containing the query point first, and
+		// the other side only if it can hold a closer point
+		double split_diff = depth % 2 == 0 ? query.x - node.x : query.y - node.y;
+		if (split_diff < 0.0)
+		{
+			searchRange(query, begin, mid, depth + 1);
+			if (split_diff * split_diff < query.best_dist_sq)
+			{
+				searchRange(query, mid + 1, end, depth + 1);
+			}
+		}
+		else
+		{
+			searchRange(query, mid + 1, end, depth + 1);
+			if (split_diff * split_diff < query.best_dist_sq)
+			{
+				searchRange(query, begin, mid, depth + 1);
+			}
+		}
+	}
+};
+
+#endif /* KD_TREE_H_ */
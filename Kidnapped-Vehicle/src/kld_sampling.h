@@ -0,0 +1,183 @@
+/*
+ * kld_sampling.h
+ *
+ * Helpers for KLD-sampling (Fox, "Adapting the Sample Size in Particle
+ * Filters Through KLD-Sampling"): a histogram over the particle state that
+ * counts occupied bins and the sample size bound derived from that count.
+ */
+
+#ifndef KLD_SAMPLING_H_
+#define KLD_SAMPLING_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * Returns the number of particles needed so that, with the probability the
+ * quantile z stands for, the Kullback-Leibler distance between the particle
+ * approximation and the true posterior stays below epsilon, given that the
+ * particles drawn so far occupy num_bins bins.
+ * @param num_bins: Number of occupied histogram bins
+ * @param epsilon: Bound on the Kullback-Leibler distance
+ * @param z: Upper standard normal quantile, e.g. 2.326 for 99%
+ */
+inline size_t kld_sample_bound(size_t num_bins, double epsilon, double z)
+{
+	if (num_bins <= 1)
+	{
+		return 1;
+	}
+
+	// Wilson-Hilferty approximation of the chi-square quantile
+	double k = double(num_bins - 1);
+	double a = 2.0 / (9.0 * k);
+	double b = 1.0 - a + sqrt(a) * z;
+	return size_t(ceil(k / (2.0 * epsilon) * b * b * b));
+}
+
+/*
+ * Set of occupied (x, y, theta) histogram bins, kept in an open addressing
+ * hash table. Clearing only bumps a generation stamp, so that a resampling
+ * step can reuse the table without touching or reallocating it.
+ */
+class KldBinSet
+{
+public:
+	KldBinSet() : bin_size_xy(0.5), bin_size_theta(M_PI / 18.0), stamp(1), num_occupied(0) {}
+
+	/*
+	 * Sets the edge lengths of the histogram bins.
+	 * @param size_xy: Edge length along x and y [m]
+	 * @param size_theta: Edge length along the heading [rad]
+	 */
+	void setBinSize(double size_xy, double size_theta)
+	{
+		bin_size_xy = size_xy;
+		bin_size_theta = size_theta;
+	}
+
+	// Makes room for max_bins occupied bins without growing the table
+	void reserve(size_t max_bins)
+	{
+		size_t capacity = 16;
+		while (capacity < 2 * max_bins)
+		{
+			capacity *= 2;
+		}
+		if (capacity > slots.size())
+		{
+			rehash(capacity);
+		}
+	}
+
+	// Marks all bins as empty
+	void clear()
+	{
+		num_occupied = 0;
+		if (++stamp == 0)
+		{
+			// The stamp wrapped around, old entries could look current again
+			for (size_t slot = 0; slot < slots.size(); slot++)
+			{
+				slots[slot].stamp = 0;
+			}
+			stamp = 1;
+		}
+	}
+
+	// Number of occupied bins
+	size_t size() const
+	{
+		return num_occupied;
+	}
+
+	/*
+	 * Marks the bin of a state as occupied.
+	 * @param (x, y) Position [m]
+	 * @param theta Heading [rad], wrapped into [0, 2 pi)
+	 * @output True if the bin was empty before
+	 */
+	bool insert(double x, double y, double theta)
+	{
+		// Keep the load factor at or below one half
+		if (2 * (num_occupied + 1) > slots.size())
+		{
+			rehash(slots.empty() ? 16 : 2 * slots.size());
+		}
+
+		double heading = theta - 2.0 * M_PI * floor(theta / (2.0 * M_PI));
+		Slot key;
+		key.bin_x = int(floor(x / bin_size_xy));
+		key.bin_y = int(floor(y / bin_size_xy));
+		key.bin_theta = int(floor(heading / bin_size_theta));
+		key.stamp = stamp;
+
+		if (!insertKey(key))
+		{
+			return false;
+		}
+		num_occupied++;
+		return true;
+	}
+
+private:
+	struct Slot
+	{
+		int bin_x;
+		int bin_y;
+		int bin_theta;
+		// Generation the slot was filled in, slots of older generations are empty
+		unsigned stamp;
+	};
+
+	// Edge lengths of the bins [m], [rad]
+	double bin_size_xy;
+	double bin_size_theta;
+	// Current generation
+	unsigned stamp;
+	size_t num_occupied;
+	// Hash table, the size is a power of two
+	std::vector<Slot> slots;
+
+	// Inserts a key with the current stamp, returns false if it was present
+	bool insertKey(const Slot &key)
+	{
+		size_t mask = slots.size() - 1;
+		size_t slot = (size_t(key.bin_x) * 73856093u ^ size_t(key.bin_y) * 19349663u ^
+									 size_t(key.bin_theta) * 83492791u) & mask;
+
+		// Linear probing until the key or an empty slot turns up
+		while (slots[slot].stamp == stamp)
+		{
+			if (slots[slot].bin_x == key.bin_x && slots[slot].bin_y == key.bin_y &&
+					slots[slot].bin_theta == key.bin_theta)
+			{
+				return false;
+			}
+			slot = (slot + 1) & mask;
+		}
+		slots[slot] = key;
+		return true;
+	}
+
+	void rehash(size_t capacity)
+	{
+		std::vector<Slot> previous(capacity);
+		for (size_t slot = 0; slot < previous.size(); slot++)
+		{
+			previous[slot].stamp = 0;
+		}
+		slots.swap(previous);
+
+		for (size_t slot = 0; slot < previous.size(); slot++)
+		{
+			if (previous[slot].stamp == stamp)
+			{
+				insertKey(previous[slot]);
+			}
+		}
+	}
+};
+
+#endif /* KLD_SAMPLING_H_ */
@@ -1,14 +1,24 @@
 #include <iostream>
-#include <ctime>
+#include <chrono>
 #include <iomanip>
 #include <random>
 
 #include "particle_filter.h"
 #include "helper_functions.h"
+#include "dataset.h"
+#include "observation_prefetcher.h"
+#include "snapshot_writer.h"
+#include "trajectory_log.h"
+#include "stage_timer.h"
+
+// Number of observation frames read ahead of the filter
+#define OBSERVATION_PREFETCH_DEPTH 8
 
 using namespace std;
 
-int main()
+// Usage: particle_filter [packed_dataset]
+// Without an argument the text dataset in data/ is read.
+int main(int argc, char **argv)
 {
 	// NOTE: These parameters are related to grading.
 	// Number of time steps before accuracy is checked by grader.
@@ -20,8 +30,9 @@ int main()
 	// Max allowable yaw error [rad]
 	double max_yaw_error = 0.05;
 
-	// Start timer.
-	int start = clock();
+	// Start timer. The filter runs on several threads, so its runtime is
+	// measured in wall-clock time.
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
 
 	// Time elapsed between measurements [sec]
 	double delta_t = 0.1;
@@ -47,51 +58,128 @@ int main()
 	normal_distribution<double> N_obs_y(0, sigma_landmark[1]);
 	double n_x, n_y, n_theta, n_range, n_heading;
 
+	// Packed form of the whole dataset, if one is given (see pack_dataset)
+	PackedDataset dataset;
+	bool packed = argc > 1;
+	if (packed && !dataset.open(argv[1]))
+	{
+		cout << "Error: Could not open packed dataset " << argv[1] << endl;
+		return -1;
+	}
+
 	// Read map data
 	Map map;
-	if (!read_map_data("data/map_data.txt", map))
+	if (packed)
+	{
+		dataset.loadMap(map);
+	}
+	else if (!read_map_data("data/map_data.txt", map))
 	{
 		cout << "Error: Could not open map file" << endl;
 		return -1;
 	}
+	// Index the landmarks for range and nearest neighbour queries
+	map.buildGridIndex(sensor_range);
+	map.buildKdTree();
 
 	// Read position data
-	vector<control_s> position_meas;
-	if (!read_control_data("data/control_data.txt", position_meas))
+	vector<control_s> control_list;
+	ConstSpan<control_s> position_meas;
+	if (packed)
+	{
+		position_meas = dataset.controls();
+	}
+	else if (read_control_data("data/control_data.txt", control_list))
+	{
+		position_meas = control_list;
+	}
+	else
 	{
 		cout << "Error: Could not open position/control measurement file" << endl;
 		return -1;
 	}
 
 	// Read ground truth data
-	vector<ground_truth> gt;
-	if (!read_gt_data("data/gt_data.txt", gt))
+	vector<ground_truth> gt_list;
+	ConstSpan<ground_truth> gt;
+	if (packed)
+	{
+		gt = dataset.groundTruth();
+	}
+	else if (read_gt_data("data/gt_data.txt", gt_list))
+	{
+		gt = gt_list;
+	}
+	else
 	{
 		cout << "Error: Could not open ground truth data file" << endl;
 		return -1;
 	}
+	if (gt.size() < position_meas.size() || (packed && dataset.numFrames() < position_meas.size()))
+	{
+		cout << "Error: Fewer ground truth positions or observation frames than time steps" << endl;
+		return -1;
+	}
 
 	// Run particle filter!
 	int num_time_steps = position_meas.size();
 	// Object of particle filter class
 	ParticleFilter pf;
+	// Adapt the number of particles to the spread of the particle cloud
+	pf.setKldSampling(50, 2000);
 	// Variables to keep track of the error
 	double total_error[3] = {0, 0, 0};
 	double cum_mean_error[3] = {0, 0, 0};
+	// Sum of the number of particles over all time steps
+	double total_particles = 0;
+	// Observations of the current time step; the text files are read by a
+	// background thread ahead of the filter
+	ObservationPrefetcher prefetcher;
+	if (!packed)
+	{
+		prefetcher.start("data/observation", num_time_steps, OBSERVATION_PREFETCH_DEPTH);
+	}
+	ConstSpan<LandmarkObs> observations;
+#if WRITE_PAR_FIL_OUTPUT
+	// Writes the particle files on a background thread
+	SnapshotWriter snapshot_writer;
+#if COMPRESS_PAR_FIL_OUTPUT
+	if (!snapshot_writer.compressTo("data/parfiloutput/par_filter_output.pfz", PAR_FIL_OUTPUT_ERROR))
+	{
+		cout << "Error: Could not create particle output archive" << endl;
+		return -1;
+	}
+#endif
+#endif
+#if WRITE_PAR_FIL_LOG
+	// Logs the particles of every time step into one file
+	TrajectoryLogWriter trajectory_log;
+	if (!trajectory_log.open("data/parfiloutput/par_filter_log.bin"))
+	{
+		cout << "Error: Could not create particle log file" << endl;
+		return -1;
+	}
+#endif
+	vector<LandmarkObs> noisy_observations;
+	// Latency of the stages of each time step
+	StageTimers stage_timers;
 
 	for (int i = 0; i < num_time_steps; ++i)
 	{
 		cout << "\nTime step: " << i << endl;
+		stage_timers.startStep();
 
 		// Read in landmark observations for current time step.
-		ostringstream file;
-		file << "data/observation/observations_" << setfill('0') << setw(6) << i+1 << ".txt";
-		vector<LandmarkObs> observations;
-		if (!read_landmark_data(file.str(), observations))
+		if (packed)
+		{
+			observations = dataset.observations(i);
+		}
+		else if (!prefetcher.nextFrame(observations))
 		{
 			cout << "Error: Could not open observation file " << i+1 << endl;
 			return -1;
 		}
+		stage_timers.stage(STAGE_LOAD);
 
 		// Initialize particle filter if this is the first time step.
 		if (!pf.initialized())
@@ -101,11 +189,13 @@ int main()
 			n_theta = N_theta_init(gen);
 			// Add noise to the ground truth for the initialization step
 			pf.init(gt[i].x + n_x, gt[i].y + n_y, gt[i].theta + n_theta, sigma_pos);
+			stage_timers.stage(STAGE_PREDICT);
 
 #if WRITE_PAR_FIL_OUTPUT
 			string par_output = string("data/parfiloutput/par_filter_output_init") + string(".txt");
-			pf.write(par_output);
+			snapshot_writer.submit(par_output, pf.particles);
 #endif
+			stage_timers.stage(STAGE_WRITE);
 
 		#if DEBUG
 			for(size_t par_index = 0; par_index < pf.particles.size(); par_index++)
@@ -122,10 +212,11 @@ int main()
 		{
 			// Predict the vehicle's next state (noiseless).
 			pf.prediction(delta_t, sigma_pos, position_meas[i-1].velocity, position_meas[i-1].yawrate);
+			stage_timers.stage(STAGE_PREDICT);
 		}
 
 		// Simulate the addition of noise to noiseless observation data.
-		vector<LandmarkObs> noisy_observations;
+		noisy_observations.clear();
 		LandmarkObs obs;
 		for (int j = 0; j < observations.size(); ++j)
 		{
@@ -137,15 +228,22 @@ int main()
 			noisy_observations.push_back(obs);
 		}
 
-		// Update the weights of the particles and resample
+		// Update the weights of the particles and resample. The simulated noise
+		// above is charged to the update, so load only covers reading the frame.
 		pf.updateWeights(sensor_range, sigma_landmark, noisy_observations, map);
+		stage_timers.stage(STAGE_UPDATE);
 		pf.resample();
+		stage_timers.stage(STAGE_RESAMPLE);
 
 		// Particles information after each iteration
 	#if WRITE_PAR_FIL_OUTPUT
 		string par_output = "data/parfiloutput/par_filter_output" + to_string(i) + ".txt";
-		pf.write(par_output);
+		snapshot_writer.submit(par_output, pf.particles);
+	#endif
+	#if WRITE_PAR_FIL_LOG
+		trajectory_log.append(i, pf.particles);
 	#endif
+		stage_timers.stage(STAGE_WRITE);
 
 	#if DEBUG
 		cout << "Post " << endl;
@@ -154,7 +252,7 @@ int main()
 
 		// Calculate and output the average weighted error of the particle filter
 		// over all time steps so far.
-		vector<Particle> particles = pf.particles;
+		const ParticleSet &particles = pf.particles;
 		int num_particles = particles.size();
 		double highest_weight = 0.0;
 		Particle best_particle;
@@ -174,10 +272,16 @@ int main()
 			total_error[j] += avg_error[j];
 			cum_mean_error[j] = total_error[j] / (double)(i + 1);
 		}
+		stage_timers.stage(STAGE_ESTIMATE);
+		stage_timers.endStep();
 
 		// Print the cumulative weighted error
 		cout << "Cumulative mean weighted error: x " << cum_mean_error[0] << " y " << cum_mean_error[1] << " yaw " << cum_mean_error[2] << endl;
 
+		// Print the number of particles chosen for this time step
+		total_particles += num_particles;
+		cout << "Number of particles: " << num_particles << endl;
+
 		// If the error is too high, say so and then exit.
 		if (i >= time_steps_before_lock_required)
 		{
@@ -200,10 +304,31 @@ int main()
 		}
 	}
 
+#if WRITE_PAR_FIL_OUTPUT
+	// Wait for the particle files still queued
+	snapshot_writer.flush();
+	if (snapshot_writer.numFailed() > 0)
+	{
+		cout << "Error: Could not write " << snapshot_writer.numFailed() << " particle files" << endl;
+	}
+#endif
+#if WRITE_PAR_FIL_LOG
+	if (!trajectory_log.close())
+	{
+		cout << "Error: Could not write particle log file" << endl;
+	}
+#endif
+
 	// Output the runtime for the filter.
-	int stop = clock();
-	double runtime = (stop - start) / double(CLOCKS_PER_SEC);
+	double runtime = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 	cout << "Runtime (sec): " << runtime << endl;
+	cout << "Average number of particles: " << total_particles / num_time_steps << endl;
+	if (!packed)
+	{
+		cout << "Observation frames waited for: " << prefetcher.numStalls() << " of " << num_time_steps
+				 << " (" << prefetcher.stallTime() << " sec)" << endl;
+	}
+	stage_timers.report(cout);
 
 	// Print success if accuracy and runtime are sufficient
 	// NOTE: This isn't just for the starter code
@@ -8,6 +8,10 @@
 #ifndef MAP_H_
 #define MAP_H_
 
+#include <math.h>
+#include <vector>
+#include "kd_tree.h"
+
 class Map
 {
 public:
@@ -23,6 +27,151 @@ public:
 
   // List of landmarks in the map
 	std::vector<single_landmark_s> landmark_list;
+
+	Map() : grid_cell_size(0.0), grid_min_x(0.0), grid_min_y(0.0),
+					grid_cols(0), grid_rows(0) {}
+
+	/*
+	 * Buckets the landmarks into a uniform grid of square cells, so that range
+	 * queries only look at the cells around the query point. Call again after
+	 * changing landmark_list.
+	 * @param cell_size: Edge length of a cell [m]. With the sensor range as
+	 *   cell size the 3x3 cells around a particle hold every landmark in range.
+	 */
+	void buildGridIndex(double cell_size)
+	{
+		grid_cell_size = cell_size;
+		grid_cols = 0;
+		grid_rows = 0;
+		cell_start.clear();
+		cell_landmarks.clear();
+
+		if (landmark_list.empty() || cell_size <= 0.0)
+		{
+			return;
+		}
+
+		// Bounding box of the landmarks
+		double max_x = landmark_list[0].x_f;
+		double max_y = landmark_list[0].y_f;
+		grid_min_x = max_x;
+		grid_min_y = max_y;
+		for (size_t land_index = 1; land_index < landmark_list.size(); land_index++)
+		{
+			grid_min_x = fmin(grid_min_x, landmark_list[land_index].x_f);
+			grid_min_y = fmin(grid_min_y, landmark_list[land_index].y_f);
+			max_x = fmax(max_x, landmark_list[land_index].x_f);
+			max_y = fmax(max_y, landmark_list[land_index].y_f);
+		}
+		grid_cols = int((max_x - grid_min_x) / cell_size) + 1;
+		grid_rows = int((max_y - grid_min_y) / cell_size) + 1;
+
+		// Count the landmarks per cell, turn the counts into start offsets and
+		// then fill in the landmark indices cell by cell
+		cell_start.assign(size_t(grid_cols) * grid_rows + 1, 0);
+		for (size_t land_index = 0; land_index < landmark_list.size(); land_index++)
+		{
+			cell_start[cellOf(landmark_list[land_index]) + 1]++;
+		}
+		for (size_t cell = 1; cell < cell_start.size(); cell++)
+		{
+			cell_start[cell] += cell_start[cell - 1];
+		}
+
+		std::vector<int> cell_fill(cell_start.begin(), cell_start.end() - 1);
+		cell_landmarks.resize(landmark_list.size());
+		for (size_t land_index = 0; land_index < landmark_list.size(); land_index++)
+		{
+			cell_landmarks[cell_fill[cellOf(landmark_list[land_index])]++] = int(land_index);
+		}
+	}
+
+	/*
+	 * Builds the k-d tree over landmark_list used for nearest landmark
+	 * queries. Call again after changing landmark_list.
+	 */
+	void buildKdTree()
+	{
+		kd_tree.build(landmark_list);
+	}
+
+	// k-d tree over landmark_list, empty until buildKdTree() is called
+	const LandmarkKdTree &kdTree() const
+	{
+		return kd_tree;
+	}
+
+	/*
+	 * Returns whether a grid index with cells of at least the given size
+	 * exists, i.e. whether gridCandidates covers that range.
+	 */
+	bool hasGridIndex(double range) const
+	{
+		return !cell_start.empty() && grid_cell_size >= range;
+	}
+
+	/*
+	 * Appends the indices (into landmark_list) of all landmarks in the 3x3
+	 * cells around a point. This is a superset of the landmarks within one
+	 * cell size of the point.
+	 * @param (x, y) Query point in map coordinates [m]
+	 * @param candidates: Vector the landmark indices are appended to
+	 */
+	void gridCandidates(double x, double y, std::vector<int> &candidates) const
+	{
+		if (cell_start.empty())
+		{
+			return;
+		}
+
+		double cell_x = floor((x - grid_min_x) / grid_cell_size);
+		double cell_y = floor((y - grid_min_y) / grid_cell_size);
+
+		// Nothing to find if the neighbourhood lies completely off the grid
+		if (cell_x < -1.0 || cell_x > grid_cols || cell_y < -1.0 || cell_y > grid_rows)
+		{
+			return;
+		}
+
+		int first_col = cell_x > 0.0 ? int(cell_x) - 1 : 0;
+		int last_col = cell_x + 1.0 < grid_cols ? int(cell_x) + 1 : grid_cols - 1;
+		int first_row = cell_y > 0.0 ? int(cell_y) - 1 : 0;
+		int last_row = cell_y + 1.0 < grid_rows ? int(cell_y) + 1 : grid_rows - 1;
+
+		for (int row = first_row; row <= last_row; row++)
+		{
+			// Cells of a row are contiguous, so a row is a single range
+			size_t row_offset = size_t(row) * grid_cols;
+			candidates.insert(candidates.end(),
+												cell_landmarks.begin() + cell_start[row_offset + first_col],
+												cell_landmarks.begin() + cell_start[row_offset + last_col + 1]);
+		}
+	}
+
+private:
+	// Edge length of the grid cells [m]
+	double grid_cell_size;
+	// Lower left corner of the grid [m]
+	double grid_min_x;
+	double grid_min_y;
+	// Number of cells along x and y
+	int grid_cols;
+	int grid_rows;
+	// Offset of the first landmark of each cell in cell_landmarks (row-major),
+	// plus one end offset
+	std::vector<int> cell_start;
+	// Landmark indices sorted by cell
+	std::vector<int> cell_landmarks;
+	// Nearest neighbour search structure over landmark_list
+	LandmarkKdTree kd_tree;
+
+	// Row-major index of the cell a landmark falls into
+	size_t cellOf(const single_landmark_s &landmark) const
+	{
+		int col = int((landmark.x_f - grid_min_x) / grid_cell_size);
+		int row = int((landmark.y_f - grid_min_y) / grid_cell_size);
+		return size_t(row) * grid_cols + col;
+	}
 };
 
 
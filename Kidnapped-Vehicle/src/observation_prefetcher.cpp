@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+#include "observation_prefetcher.h"
+
+using namespace std;
+
+ObservationPrefetcher::ObservationPrefetcher()
+	: num_frames(0), num_produced(0), num_consumed(0), holding_frame(false),
+		stopping(false), num_stalls(0), stall_time(0.0)
+{
+}
+
+ObservationPrefetcher::~ObservationPrefetcher()
+{
+	stop();
+}
+
+void ObservationPrefetcher::start(const string &frame_directory, size_t frame_count, size_t depth)
+{
+	stop();
+
+	directory = frame_directory;
+	num_frames = frame_count;
+	// One more slot than the depth for the frame the filter holds
+	slots.resize(max(depth, size_t(1)) + 1);
+	num_produced = 0;
+	num_consumed = 0;
+	holding_frame = false;
+	stopping = false;
+	num_stalls = 0;
+	stall_time = 0.0;
+
+	loader = thread(&ObservationPrefetcher::loaderLoop, this);
+}
+
+void ObservationPrefetcher::stop()
+{
+	if (!loader.joinable())
+	{
+		return;
+	}
+
+	{
+		lock_guard<mutex> lock(ring_mutex);
+		stopping = true;
+	}
+	slot_free.notify_one();
+	loader.join();
+}
+
+bool ObservationPrefetcher::nextFrame(ConstSpan<LandmarkObs> &observations)
+{
+	unique_lock<mutex> lock(ring_mutex);
+
+	// Give the previous frame back to the loader
+	if (holding_frame)
+	{
+		num_consumed++;
+		holding_frame = false;
+		slot_free.notify_one();
+	}
+	if (num_consumed >= num_frames)
+	{
+		return false;
+	}
+
+	if (num_produced <= num_consumed)
+	{
+		num_stalls++;
+		chrono::steady_clock::time_point wait_start = chrono::steady_clock::now();
+		while (num_produced <= num_consumed)
+		{
+			frame_ready.wait(lock);
+		}
+		stall_time += chrono::duration<double>(chrono::steady_clock::now() - wait_start).count();
+	}
+
+	Slot &slot = slots[num_consumed % slots.size()];
+	if (!slot.loaded)
+	{
+		return false;
+	}
+	holding_frame = true;
+	observations = slot.observations;
+	return true;
+}
+
+void ObservationPrefetcher::loaderLoop()
+{
+	for (size_t frame = 0; frame < num_frames; frame++)
+	{
+		{
+			unique_lock<mutex> lock(ring_mutex);
+			while (!stopping && frame - num_consumed >= slots.size())
+			{
+				slot_free.wait(lock);
+			}
+			if (stopping)
+			{
+				return;
+			}
+		}
+
+		// The slot is not visible to the filter until the frame is published
+		Slot &slot = slots[frame % slots.size()];
+		ostringstream file;
+		file << directory << "/observations_" << setfill('0') << setw(6) << frame+1 << ".txt";
+		slot.observations.clear();
+		slot.loaded = read_landmark_data(file.str(), slot.observations);
+
+		{
+			lock_guard<mutex> lock(ring_mutex);
+			num_produced++;
+		}
+		frame_ready.notify_one();
+
+		// Nothing after a missing frame is of use
+		if (!slot.loaded)
+		{
+			return;
+		}
+	}
+}
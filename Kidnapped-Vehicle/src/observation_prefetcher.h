@@ -0,0 +1,88 @@
+/*
+ * observation_prefetcher.h
+ *
+ * Background loader of the per-step observation files of the text dataset.
+ * A loader thread reads and parses the frames ahead of the filter into a ring
+ * of reusable buffers, so that file I/O overlaps with filtering.
+ */
+
+#ifndef OBSERVATION_PREFETCHER_H_
+#define OBSERVATION_PREFETCHER_H_
+
+#include <stddef.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "helper_functions.h"
+
+class ObservationPrefetcher
+{
+public:
+	ObservationPrefetcher();
+
+	// Stops and joins the loader thread
+	~ObservationPrefetcher();
+
+	/*
+	 * Starts loading the frames observations_000001.txt onwards.
+	 * @param directory: Directory holding the observation files
+	 * @param num_frames: Number of frames to load
+	 * @param depth: Number of frames loaded ahead of the frame the filter
+	 *   holds, at least 1
+	 */
+	void start(const std::string &directory, size_t num_frames, size_t depth);
+
+	/*
+	 * Hands out the next frame, waiting for the loader if it is not read yet.
+	 * The frame handed out before goes back to the loader, so a span stays
+	 * valid until the next call.
+	 * @output observations: Observations of the frame
+	 * @output False if the frame file could not be read or all frames were
+	 *   handed out
+	 */
+	bool nextFrame(ConstSpan<LandmarkObs> &observations);
+
+	// Number of frames the filter had to wait for
+	size_t numStalls() const
+	{
+		return num_stalls;
+	}
+
+	// Time spent waiting for frames [sec]
+	double stallTime() const
+	{
+		return stall_time;
+	}
+
+private:
+	struct Slot
+	{
+		std::vector<LandmarkObs> observations;
+		bool loaded;
+	};
+
+	std::thread loader;
+	std::vector<Slot> slots;
+	std::string directory;
+	size_t num_frames;
+
+	// Frames [num_consumed, num_produced) are loaded and not handed back yet
+	std::mutex ring_mutex;
+	std::condition_variable frame_ready;
+	std::condition_variable slot_free;
+	size_t num_produced;
+	size_t num_consumed;
+	bool holding_frame;
+	bool stopping;
+
+	size_t num_stalls;
+	double stall_time;
+
+	void loaderLoop();
+	void stop();
+};
+
+#endif /* OBSERVATION_PREFETCHER_H_ */
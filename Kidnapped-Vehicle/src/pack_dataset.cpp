@@ -0,0 +1,121 @@
+/*
+ * pack_dataset.cpp
+ *
+ * Converts the text dataset (map, control and ground truth files plus one
+ * observation file per time step) into a single packed dataset (dataset.h).
+ *
+ * Usage: pack_dataset [data_directory] [output_file]
+ * The defaults are "data" and "data/dataset.bin".
+ */
+
+#include <stdio.h>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+#include "dataset.h"
+#include "helper_functions.h"
+
+using namespace std;
+
+// Writes zeros up to a file offset
+static bool pad_to(FILE *file, uint64_t offset)
+{
+	static const char zeros[PACKED_DATASET_ALIGNMENT] = {0};
+	long position = ftell(file);
+	if (position < 0 || uint64_t(position) > offset)
+	{
+		return false;
+	}
+	return fwrite(zeros, 1, size_t(offset - uint64_t(position)), file) == offset - uint64_t(position);
+}
+
+template <typename T>
+static bool write_section(FILE *file, uint64_t offset, const T *records, size_t count)
+{
+	return pad_to(file, offset) && fwrite(records, sizeof(T), count, file) == count;
+}
+
+int main(int argc, char **argv)
+{
+	string data_directory = argc > 1 ? argv[1] : "data";
+	string output_file = argc > 2 ? argv[2] : data_directory + "/dataset.bin";
+
+	Map map;
+	if (!read_map_data(data_directory + "/map_data.txt", map))
+	{
+		cout << "Error: Could not open map file" << endl;
+		return -1;
+	}
+
+	vector<control_s> position_meas;
+	if (!read_control_data(data_directory + "/control_data.txt", position_meas))
+	{
+		cout << "Error: Could not open position/control measurement file" << endl;
+		return -1;
+	}
+
+	vector<ground_truth> gt;
+	if (!read_gt_data(data_directory + "/gt_data.txt", gt))
+	{
+		cout << "Error: Could not open ground truth data file" << endl;
+		return -1;
+	}
+
+	// One observation frame per control measurement, as main.cpp reads them
+	size_t num_frames = position_meas.size();
+	vector<uint64_t> frame_index(1, 0);
+	vector<LandmarkObs> frame_observations;
+	vector<LandmarkObs> observations;
+	for (size_t frame = 0; frame < num_frames; frame++)
+	{
+		ostringstream file;
+		file << data_directory << "/observation/observations_" << setfill('0') << setw(6) << frame+1 << ".txt";
+		frame_observations.clear();
+		if (!read_landmark_data(file.str(), frame_observations))
+		{
+			cout << "Error: Could not open observation file " << frame+1 << endl;
+			return -1;
+		}
+
+		// The text files carry no landmark ids; zero the records as a whole so
+		// that no indeterminate bytes (id, padding) end up in the file
+		for (size_t obs_index = 0; obs_index < frame_observations.size(); obs_index++)
+		{
+			LandmarkObs obs;
+			memset(&obs, 0, sizeof(obs));
+			obs.x = frame_observations[obs_index].x;
+			obs.y = frame_observations[obs_index].y;
+			observations.push_back(obs);
+		}
+		frame_index.push_back(observations.size());
+	}
+
+	PackedDatasetHeader header;
+	packed_dataset_layout(map.landmark_list.size(), position_meas.size(), gt.size(),
+												num_frames, observations.size(), header);
+
+	FILE *file = fopen(output_file.c_str(), "wb");
+	if (file == NULL)
+	{
+		cout << "Error: Could not create " << output_file << endl;
+		return -1;
+	}
+
+	bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+								 write_section(file, header.landmarks_offset, map.landmark_list.data(),
+															 map.landmark_list.size()) &&
+								 write_section(file, header.controls_offset, position_meas.data(), position_meas.size()) &&
+								 write_section(file, header.ground_truth_offset, gt.data(), gt.size()) &&
+								 write_section(file, header.frame_index_offset, frame_index.data(), frame_index.size()) &&
+								 write_section(file, header.observations_offset, observations.data(), observations.size());
+	if (fclose(file) != 0 || !written)
+	{
+		cout << "Error: Could not write " << output_file << endl;
+		return -1;
+	}
+
+	cout << "Packed " << map.landmark_list.size() << " landmarks, " << num_frames << " time steps and "
+			 << observations.size() << " observations into " << output_file << endl;
+	return 0;
+}
@@ -1,19 +1,41 @@
-#include <random>
 #include <algorithm>
 #include <iostream>
 #include <numeric>
+#include <iterator>
+#include <sstream>
 
 #include "particle_filter.h"
+#include "filter_kernels.h"
+#include "snapshot_writer.h"
+
+// Number of landmarks in sensor range up to which observations are associated
+// by brute force rather than through the k-d tree of the map
+#define KD_TREE_MIN_LANDMARKS 32
+
+// Number of particles the filter stages hand to a thread at a time
+#define PARALLEL_GRAIN 256
+
+// Number of predictions after which the cached heading cosines and sines are
+// pulled back onto the unit circle
+#define TRIG_RENORMALIZE_STEPS 16
 
 // Initializes particle filter by initializing particles to
 // Gaussian distribution around first position and all the weights set to 1.
-void ParticleFilter::init(double x, double y, double theta, double std[])
+void ParticleFilter::init(double x, double y, double theta, const double std[])
 {
-	// NOTE: The number of particles needs to be tuned
-	num_particles = 200;
+	// With KLD-sampling the initial number of particles has to lie within its
+	// limits, and the buffers have to hold the most particles it can draw
+	size_t max_particles = num_particles;
+	if(kld_sampling)
+	{
+		num_particles = max(kld_min_particles, min(num_particles, kld_max_particles));
+		max_particles = max(num_particles, kld_max_particles);
+		kld_bins.reserve(max_particles);
+	}
 
-	// Object of random number engine class that generate pseudo-random numbers
-	default_random_engine gen;
+	// The random numbers of every stage are keyed by the time step, which
+	// starts over with the initialization
+	time_step = 0;
 
   // Standard deviations for x, y, and theta
 	double std_x, std_y, std_theta;
@@ -23,63 +45,70 @@ void ParticleFilter::init(double x, double y, double theta, double std[])
 	std_y = std[1];
   std_theta = std[2];
 
-  // Create a normal (Gaussian) distribution for position along x.
-	normal_distribution<double> dist_x(x, std_x);
-  // Create a normal (Gaussian) distribution for position along y.
-	normal_distribution<double> dist_y(y, std_y);
-  // Create a normal (Gaussian) distribution for heading of the car.
-	normal_distribution<double> dist_theta(theta, std_theta);
+	// Allocate the particle storage and the scratch buffers of the filter
+	// steps once
+	particles.reserve(max_particles);
+	resampled_particles.reserve(max_particles);
+	noise_x.reserve(max_particles);
+	noise_y.reserve(max_particles);
+	noise_theta.reserve(max_particles);
+	cumulative_weights.reserve(max_particles);
+	chunk_sums.reserve(max_particles / PARALLEL_GRAIN + 1);
+	particles.resize(num_particles);
+	resampled_particles.resize(num_particles);
+	noise_x.resize(num_particles);
+	noise_y.resize(num_particles);
+	noise_theta.resize(num_particles);
+	cumulative_weights.resize(num_particles);
+	resample_positions.resize(num_particles);
+
+	// Draw the Gaussian noise of all particles at once
+	// NOTE: The noise of a particle only depends on the seed, the time step
+	//       and the particle index (see CounterRng).
+	gaussian_noise(rng, RANDOM_INIT, time_step, 0, num_particles, std_x, std_y, std_theta,
+								 noise_x.data(), noise_y.data(), noise_theta.data());
 
 	// Add random Gaussian noise to each particle.
 	for (int par_index = 0; par_index < num_particles; ++par_index)
 	{
 		double sample_x, sample_y, sample_theta;
 
-		// Sample from these normal distrubtions for x, y and theta
-    // NOTE 1: "gen" is the random engine initialized earlier
-		// NOTE 2: The generator object (g) supplies uniformly-distributed random
-		//         integers through its operator() member function.
-		//         The normal_distribution object transforms the values obtained
-		//         this way so that successive calls to this member function with
-		//         the same arguments produce floating-point values that follow a
-		//         Normal distribution with the appropriate parameters.
-		// NOTE 3: dist_x's constructor is overloaded with a member function of the
-		//         same name.
-		sample_x = dist_x(gen);
-    sample_y = dist_y(gen);
-    sample_theta = dist_theta(gen);
-
-		// Variable of type Particle to store values before being appended to
-		// the vector of particles
-		Particle new_particle;
+		// Sample from normal distributions around x, y and theta
+		sample_x = x + noise_x[par_index];
+		sample_y = y + noise_y[par_index];
+		sample_theta = theta + noise_theta[par_index];
 
 		// Set the id of the particle to be the same as the current index
-		new_particle.id = par_index;
+		particles.id[par_index] = par_index;
 		// Set the particle position in x, y and angle theta from the individual
 		// samples from the distribution of the respective means and sigmas
-		new_particle.x = sample_x;
-		new_particle.y = sample_y;
-		new_particle.theta = sample_theta;
+		particles.x[par_index] = sample_x;
+		particles.y[par_index] = sample_y;
+		particles.theta[par_index] = sample_theta;
+		particles.cos_theta[par_index] = cos(sample_theta);
+		particles.sin_theta[par_index] = sin(sample_theta);
 
 		// The weight needs to be set to 1.0 initially
-		new_particle.weight = 1.0;
-
-		// Append the new particle to the vector
-		particles.push_back(new_particle);
+		particles.weight[par_index] = 1.0;
+		particles.log_weight[par_index] = 0.0;
 	}
 
+	// All particles are equally likely so far
+	weights_reset = true;
+	effective_sample_size = num_particles;
+
 	// Since this function is called only once(first measurement), set to True
 	is_initialized = true;
 }
 
 // Predicts the state(set of particles) for the next time step
 // using the process model.
-void ParticleFilter::prediction(double delta_t, double std_pos[],
+void ParticleFilter::prediction(double delta_t, const double std_pos[],
 																double velocity, double yaw_rate)
 {
 	// Add measurements to each particle and add random Gaussian noise.
-	// Object of random number engine class that generate pseudo-random numbers
-	default_random_engine gen;
+	// Every prediction starts a new time step of the random streams.
+	time_step++;
 
   // Standard deviations for x, y, and theta
 	double std_x, std_y, std_theta;
@@ -89,80 +118,84 @@ void ParticleFilter::prediction(double delta_t, double std_pos[],
 	std_y = std_pos[1];
   std_theta = std_pos[2];
 
-	// Create a normal (Gaussian) distribution for noise along position x.
-	normal_distribution<double> noise_dist_x(0, std_x);
-	// Create a normal (Gaussian) distribution for noise along position y.
-	normal_distribution<double> noise_dist_y(0, std_y);
-	// Create a normal (Gaussian) distribution for noise of direction theta.
-	normal_distribution<double> noise_dist_theta(0, std_theta);
-
-	// NOTE: Adding noise using the following resources
-	//  http://en.cppreference.com/w/cpp/numeric/random/normal_distribution
-	//  http://www.cplusplus.com/reference/random/default_random_engine/
-
-	// Prediction for position x,y and angle theta for each of the particles
-	for(size_t par_index = 0; par_index < particles.size(); par_index++)
+	size_t count = particles.size();
+	noise_x.resize(count);
+	noise_y.resize(count);
+	noise_theta.resize(count);
+
+	// Prediction for position x,y and angle theta for each of the particles.
+	// The yaw rate is the same for every particle, so the divide by zero check
+	// picks the kernel once instead of branching per particle. Every thread
+	// runs the kernel over its slice of the particles.
+	bool turning = abs(yaw_rate) > 0.0001;
+	bool renormalize = time_step % TRIG_RENORMALIZE_STEPS == 0;
+	thread_pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t begin, size_t end, size_t)
 	{
-		// Temporary variable to store the particle's previous state's theta
-		double prev_theta = particles[par_index].theta;
+		// Draw the noise of the slice up front, so the prediction kernel only
+		// streams over arrays
+		gaussian_noise(rng, RANDOM_PREDICTION, time_step, begin, end - begin,
+									 std_x, std_y, std_theta, noise_x.data() + begin,
+									 noise_y.data() + begin, noise_theta.data() + begin);
 
-		// Avoid divide by zero error and update prediction for the particle
-		if(abs(yaw_rate) > 0.0001)
+		if(turning)
 		{
-			// Update the position x, y and angle theta of the particle
-			particles[par_index].x += (velocity/yaw_rate) * \
-																 (sin(prev_theta + (yaw_rate * delta_t)) - \
-																	sin(prev_theta));
-			particles[par_index].y += (velocity/yaw_rate) * \
-																 (cos(prev_theta) - \
-																	cos(prev_theta + (yaw_rate * delta_t)));
+			predict_turning(particles.x.data() + begin, particles.y.data() + begin,
+											particles.theta.data() + begin, particles.cos_theta.data() + begin,
+											particles.sin_theta.data() + begin, noise_x.data() + begin,
+											noise_y.data() + begin, noise_theta.data() + begin, end - begin,
+											velocity, yaw_rate, delta_t, renormalize);
 		}
 		else
 		{
-			// Update the position x, y and angle theta of the particle
-			particles[par_index].x += velocity * delta_t * cos(prev_theta);
-			particles[par_index].y += velocity * delta_t * sin(prev_theta);
+			predict_straight(particles.x.data() + begin, particles.y.data() + begin,
+											 particles.theta.data() + begin, particles.cos_theta.data() + begin,
+											 particles.sin_theta.data() + begin, noise_x.data() + begin,
+											 noise_y.data() + begin, noise_theta.data() + begin, end - begin,
+											 velocity, yaw_rate, delta_t, renormalize);
 		}
-		// Update theta
-		particles[par_index].theta = prev_theta + yaw_rate * delta_t;
+	});
+}
 
-		// Add random gaussian noise for each of the above updated measurements
-		particles[par_index].x += noise_dist_x(gen);
-		particles[par_index].y += noise_dist_y(gen);
-		particles[par_index].theta += noise_dist_theta(gen);
+// Index of the landmark closest to (x, y); landmarks must not be empty.
+// Comparing squared distances gives the same result without taking square
+// roots.
+static size_t nearest_landmark(const vector<Map::single_landmark_s> &landmarks, double x, double y)
+{
+	// Start of with the maximum possible value
+	double minDistance = DBL_MAX;
+	size_t indexOfLandmark = 0;
+
+	for(size_t land_index = 0; land_index < landmarks.size(); land_index++)
+	{
+			double diff_x = landmarks[land_index].x_f - x;
+			double diff_y = landmarks[land_index].y_f - y;
+			double currentDistance = diff_x * diff_x + diff_y * diff_y;
+
+			// Update the minimum distance found and the index if
+			// another landmark is closer to this observation
+			if(currentDistance <= minDistance)
+			{
+					minDistance = currentDistance;
+					indexOfLandmark = land_index;
+			}
 	}
+	return indexOfLandmark;
 }
 
 // Find the closest landmark to the current observation
-vector<LandmarkObs> ParticleFilter::dataAssociation(vector<Map::single_landmark_s> landmarks,
-																			 							vector<LandmarkObs> observations)
+void ParticleFilter::dataAssociation(const vector<Map::single_landmark_s> &landmarks,
+																		 const vector<LandmarkObs> &observations,
+																		 vector<LandmarkObs> &associatedLandmarks)
 {
 	// Vector of associated landmarks
-	vector<LandmarkObs> associatedLandmarks;
+	associatedLandmarks.clear();
 
 	// Go through list of observations
 	for(size_t obs_index = 0; obs_index < observations.size(); obs_index++)
 	{
-			// Start of with the maximum possible value
-			double minDistance = DBL_MAX;
-			size_t indexOfLandmark;
-
 			// Find the landmark closest to the observation
-			for(size_t land_index = 0; land_index < landmarks.size(); land_index++)
-			{
-					double currentDistance = dist(landmarks[land_index].x_f,
-																				landmarks[land_index].y_f,
-																				observations[obs_index].x,
-																				observations[obs_index].y);
-
-					// Update the minimum distance found and the index if
-					// another landmark is closer to this observation
-					if(currentDistance <= minDistance)
-					{
-							minDistance = currentDistance;
-							indexOfLandmark = land_index;
-					}
-			}
+			size_t indexOfLandmark = nearest_landmark(landmarks, observations[obs_index].x,
+																								observations[obs_index].y);
 
 			LandmarkObs closestLandmark;
 			closestLandmark.id = landmarks[indexOfLandmark].id_i;
@@ -170,184 +203,476 @@ vector<LandmarkObs> ParticleFilter::dataAssociation(vector<Map::single_landmark_
 			closestLandmark.y = landmarks[indexOfLandmark].y_f;
 			associatedLandmarks.push_back(closestLandmark);
 	}
-
-	// Return the associated landmarks
-	return associatedLandmarks;
 }
 
-// Update all the weights of the particles in the particle filter
-void ParticleFilter::updateWeights(double sensor_range, double std_landmark[],
-																	 vector<LandmarkObs> observations,
-																	 Map map_landmarks)
+// Transform the observations into map coordinates from the perspective of the
+// given particle and associate each with the closest landmark in sensor range.
+// The results are left in the scratch space of the calling thread.
+void ParticleFilter::associateObservations(size_t par_index, double sensor_range,
+																					 ConstSpan<LandmarkObs> observations,
+																					 const Map &map_landmarks,
+																					 ThreadScratch &scratch)
 {
-	// Set standard deviations for x, y
-	double std_x, std_y;
-	double var_x, var_y;
-
-	// Set the standard deviation and calculate variance
-	std_x = std_landmark[0];
-	std_y = std_landmark[1];
-	var_x = std_x * std_x;
-	var_y = std_y * std_y;
-
-	// Go through the list of particles
-	for(size_t par_index = 0; par_index < particles.size(); par_index++)
+	// For the given list of landmarks find the predicted landmarks within
+	// the range of the car sensor. With a grid index only the landmarks of the
+	// cells around the particle need to be checked.
+	scratch.predicted_landmarks.clear();
+	if(map_landmarks.hasGridIndex(sensor_range))
+	{
+		scratch.landmark_candidates.clear();
+		map_landmarks.gridCandidates(particles.x[par_index], particles.y[par_index],
+																 scratch.landmark_candidates);
+		for(size_t cand_index = 0; cand_index < scratch.landmark_candidates.size(); cand_index++)
+		{
+			const Map::single_landmark_s &landmark = map_landmarks.landmark_list[scratch.landmark_candidates[cand_index]];
+			if(dist(particles.x[par_index], particles.y[par_index],
+							landmark.x_f, landmark.y_f) <= sensor_range)
+			{
+				scratch.predicted_landmarks.push_back(landmark);
+			}
+		}
+	}
+	else
 	{
-		// For the given list of landmarks find the predicted landmarks within
-		// the range of the car sensor
-		vector<Map::single_landmark_s> predicted_landmarks;
 		for(size_t land_index = 0; land_index < map_landmarks.landmark_list.size(); land_index++)
 		{
 			// Calculate the difference between the particle prediction & landmark
-			double distanceDiff = dist(particles[par_index].x,
-																 particles[par_index].y,
+			double distanceDiff = dist(particles.x[par_index],
+																 particles.y[par_index],
 																 map_landmarks.landmark_list[land_index].x_f,
-															 	 map_landmarks.landmark_list[land_index].y_f);
+																 map_landmarks.landmark_list[land_index].y_f);
 
 			// Create a new list of landmarks within sensor range for data association
 			if(distanceDiff <= sensor_range)
 			{
-				predicted_landmarks.push_back(map_landmarks.landmark_list[land_index]);
+				scratch.predicted_landmarks.push_back(map_landmarks.landmark_list[land_index]);
 			}
 		}
+	}
+
+	// For the list of observations, convert to map-coordinates
+	scratch.converted_observations.clear();
+	for(size_t obs_index = 0; obs_index < observations.size(); obs_index++)
+	{
+			// Convert from car to map-coordinates
+			LandmarkObs convertedObs = convertVehicleToMapCoords(observations[obs_index],
+																													 par_index);
+
+			// Push to the new list of converted observations
+			scratch.converted_observations.push_back(convertedObs);
+	}
+
+	// Using the converted observations perform data association. Without any
+	// landmark in range nothing can be associated.
+	scratch.associated_landmarks.clear();
+	if(scratch.predicted_landmarks.empty())
+	{
+		return;
+	}
 
-		// Vector for converted observations
-		vector<LandmarkObs> convertedObservations;
+	// Brute force association is quadratic in the number of landmarks in
+	// range, for dense maps search the nearest one in the k-d tree instead
+	const LandmarkKdTree &kd_tree = map_landmarks.kdTree();
+	if(scratch.predicted_landmarks.size() <= KD_TREE_MIN_LANDMARKS || kd_tree.empty())
+	{
+		dataAssociation(scratch.predicted_landmarks, scratch.converted_observations,
+										scratch.associated_landmarks);
+		return;
+	}
 
-		// For the list of observations, convert to map-coordinates, find the
-		// closest landmark and finally update the weight of the particle
-		for(size_t obs_index = 0; obs_index < observations.size(); obs_index++)
+	for(size_t obs_index = 0; obs_index < scratch.converted_observations.size(); obs_index++)
+	{
+		const LandmarkObs &observation = scratch.converted_observations[obs_index];
+		int land_index;
+		double dist_sq;
+		bool found = kd_tree.nearestWithin(observation.x, observation.y,
+																			 particles.x[par_index], particles.y[par_index],
+																			 sensor_range, &land_index, &dist_sq);
+
+		// The tree tests d^2 <= range^2 while the landmarks in range were
+		// selected with dist(...) <= range; at the boundary the two can
+		// disagree, so fall back to the landmarks in range on a miss
+		const Map::single_landmark_s &landmark = found ?
+			map_landmarks.landmark_list[land_index] :
+			scratch.predicted_landmarks[nearest_landmark(scratch.predicted_landmarks,
+																									 observation.x, observation.y)];
+		LandmarkObs closestLandmark;
+		closestLandmark.id = landmark.id_i;
+		closestLandmark.x = landmark.x_f;
+		closestLandmark.y = landmark.y_f;
+		scratch.associated_landmarks.push_back(closestLandmark);
+	}
+}
+
+// Update all the weights of the particles in the particle filter
+void ParticleFilter::updateWeights(double sensor_range, const double std_landmark[],
+																	 ConstSpan<LandmarkObs> observations,
+																	 const Map &map_landmarks)
+{
+	size_t count = particles.size();
+	size_t num_obs = observations.size();
+
+	// Residuals between associated landmark and observation, one row of
+	// particles per observation
+	residual_x.resize(num_obs * count);
+	residual_y.resize(num_obs * count);
+
+	// Size the scratch space for the worst case up front, so that a particle
+	// seeing more landmarks or observations than any before does not
+	// allocate. Reserving is a no-op once the capacity suffices.
+	size_t num_landmarks = map_landmarks.landmark_list.size();
+	for(size_t thread_index = 0; thread_index < thread_scratch.size(); thread_index++)
+	{
+		ThreadScratch &scratch = thread_scratch[thread_index];
+		scratch.landmark_candidates.reserve(num_landmarks);
+		scratch.predicted_landmarks.reserve(num_landmarks);
+		scratch.converted_observations.reserve(num_obs);
+		scratch.associated_landmarks.reserve(num_obs);
+	}
+
+	// Go through the list of particles, each thread associating the
+	// observations of its particles in its own scratch space
+	thread_pool.parallelFor(count, PARALLEL_GRAIN,
+													[&](size_t begin, size_t end, size_t thread_index)
+	{
+		ThreadScratch &scratch = thread_scratch[thread_index];
+		for(size_t par_index = begin; par_index < end; par_index++)
 		{
-				// Convert from car to map-coordinates
-				LandmarkObs convertedObs = convertVehicleToMapCoords(observations[obs_index],
-																														 particles[par_index]);
+			associateObservations(par_index, sensor_range, observations, map_landmarks, scratch);
 
-				// Push to the new list of converted observations
-				convertedObservations.push_back(convertedObs);
+			for(size_t obs_index = 0; obs_index < num_obs; obs_index++)
+			{
+				size_t residual_index = obs_index * count + par_index;
+
+				// An observation without any landmark in range counts as a miss at
+				// the edge of the sensor range
+				if(scratch.associated_landmarks.empty())
+				{
+					residual_x[residual_index] = sensor_range;
+					residual_y[residual_index] = sensor_range;
+					continue;
+				}
+
+				residual_x[residual_index] = scratch.associated_landmarks[obs_index].x - \
+																		 scratch.converted_observations[obs_index].x;
+				residual_y[residual_index] = scratch.associated_landmarks[obs_index].y - \
+																		 scratch.converted_observations[obs_index].y;
+			}
 		}
+	});
+
+	// Update the weights of each particle using a multi-variate Gaussian
+	// distribution over all of its observations.
+	// Info: https://en.wikipedia.org/wiki/Multivariate_normal_distribution
+	// Right after resampling every particle stands for the same share of the
+	// posterior, otherwise the weights carry over from the last update.
+	// The weights are kept as log weights, which cannot underflow however
+	// many observations there are or however tight the measurement noise is.
+	bool reset = weights_reset;
+	weights_reset = false;
+	clearThreadScratch();
+	thread_pool.parallelFor(count, PARALLEL_GRAIN,
+													[&](size_t begin, size_t end, size_t thread_index)
+	{
+		ThreadScratch &scratch = thread_scratch[thread_index];
+		double *log_weight = particles.log_weight.data();
+		if(reset)
+		{
+			fill(log_weight + begin, log_weight + end, 0.0);
+		}
+		observation_log_likelihood(residual_x.data() + begin, residual_y.data() + begin,
+															 end - begin, count, num_obs,
+															 std_landmark[0], std_landmark[1], log_weight + begin);
 
-		// Using the converted observations perform data association
-		vector<LandmarkObs> associatedLandmarks = dataAssociation(predicted_landmarks,
-																															convertedObservations);
+		for(size_t par_index = begin; par_index < end; par_index++)
+		{
+			if(log_weight[par_index] > scratch.best_log_weight)
+			{
+				scratch.best_log_weight = log_weight[par_index];
+				scratch.best_index = par_index;
+			}
+		}
+	});
 
-		// Variable to store the result of the multivariate-gaussian
-		double multi_gaussian = 1.0;
+	// The best particle has the highest log weight. Of equally good
+	// particles the first one counts.
+	size_t best_index = 0;
+	double max_log_weight = -DBL_MAX;
+	for(size_t thread_index = 0; thread_index < thread_scratch.size(); thread_index++)
+	{
+		const ThreadScratch &scratch = thread_scratch[thread_index];
+		if(scratch.best_log_weight > max_log_weight ||
+			 (scratch.best_log_weight == max_log_weight && scratch.best_index < best_index))
+		{
+			max_log_weight = scratch.best_log_weight;
+			best_index = scratch.best_index;
+		}
+	}
+
+	// Log-sum-exp normalization: relative to the highest log weight the
+	// weights lie in (0, 1], and the best particle contributes exactly 1 to
+	// their sum. The sums are taken per chunk of particles and the chunk sums
+	// added in order, so the result does not depend on the number of threads.
+	chunk_sums.resize((count + PARALLEL_GRAIN - 1) / PARALLEL_GRAIN);
+	thread_pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t begin, size_t end, size_t)
+	{
+		for(size_t chunk_begin = begin; chunk_begin < end; chunk_begin += PARALLEL_GRAIN)
+		{
+			size_t chunk_end = min(chunk_begin + PARALLEL_GRAIN, end);
+			chunk_sums[chunk_begin / PARALLEL_GRAIN] =
+					exp_weights(particles.log_weight.data() + chunk_begin, chunk_end - chunk_begin,
+											max_log_weight, particles.weight.data() + chunk_begin);
+		}
+	});
+	double weight_sum = accumulate(chunk_sums.begin(), chunk_sums.end(), 0.0);
 
-		// Update weight of the particle
-		for(size_t obs_index = 0; obs_index < associatedLandmarks.size(); obs_index++)
+	// Normalize the weights in both domains and compute the effective sample
+	// size from them
+	double log_weight_sum = max_log_weight + log(weight_sum);
+	thread_pool.parallelFor(count, PARALLEL_GRAIN, [&](size_t begin, size_t end, size_t)
+	{
+		for(size_t chunk_begin = begin; chunk_begin < end; chunk_begin += PARALLEL_GRAIN)
 		{
-			// Update the weights of each particle using a
-			// a multi-variate Gaussian distribution.
-			// Info: https://en.wikipedia.org/wiki/Multivariate_normal_distribution
-			// Set standard deviations for x, y
-			double std_x, std_y;
-			double var_x, var_y;
-
-			// Set the standard deviation and calculate variance
-			std_x = std_landmark[0];
-			std_y = std_landmark[1];
-			var_x = std_x * std_x;
-			var_y = std_y * std_y;
-
-			// Variables to store the square of the difference between measured and
-			// predicted x and y values
-			double sq_diff_x = associatedLandmarks[obs_index].x - \
-			convertedObservations[obs_index].x;
-			double sq_diff_y = associatedLandmarks[obs_index].y - \
-			convertedObservations[obs_index].y;
-
-			sq_diff_x = sq_diff_x * sq_diff_x;
-			sq_diff_y = sq_diff_y * sq_diff_y;
-
-			multi_gaussian *= (1 / (2 * M_PI * std_x * std_y)) * \
-												exp(-((sq_diff_x) / (2 * var_x) + (sq_diff_y) / (2 * var_y)));
+			size_t chunk_end = min(chunk_begin + PARALLEL_GRAIN, end);
+			double sum_sq = 0.0;
+			for(size_t par_index = chunk_begin; par_index < chunk_end; par_index++)
+			{
+				double weight = particles.weight[par_index] / weight_sum;
+				particles.weight[par_index] = weight;
+				particles.log_weight[par_index] -= log_weight_sum;
+				sum_sq += weight * weight;
+			}
+			chunk_sums[chunk_begin / PARALLEL_GRAIN] = sum_sq;
 		}
+	});
+	effective_sample_size = 1.0 / accumulate(chunk_sums.begin(), chunk_sums.end(), 0.0);
 
-		// Update the weight of the particle
-		particles[par_index].weight = multi_gaussian;
+	// Keep the associations of the best particle for debugging
+	if(count > 0)
+	{
+		ThreadScratch &scratch = thread_scratch[0];
+		associateObservations(best_index, sensor_range, observations, map_landmarks, scratch);
+		recordAssociations(best_index, scratch.converted_observations, scratch.associated_landmarks);
+	}
+}
+
+// Reset the best particles found by all threads
+void ParticleFilter::clearThreadScratch()
+{
+	for(size_t thread_index = 0; thread_index < thread_scratch.size(); thread_index++)
+	{
+		thread_scratch[thread_index].best_log_weight = -DBL_MAX;
+		thread_scratch[thread_index].best_index = 0;
 	}
 }
 
 // Resample particles with replacement with probability proportional to weight.
 void ParticleFilter::resample()
 {
-	// Copy of the particles vector list
-	vector<Particle> particlesCopy = particles;
+	size_t count = particles.size();
 
-	// Empty the existing particle list
-	particles.erase(particles.begin(), particles.end());
+	// While the weights are spread over enough particles resampling would
+	// only add noise, keep the weighted particles for the next update
+	if(resample_threshold < 1.0 && effective_sample_size >= resample_threshold * count)
+	{
+		return;
+	}
+
+	// The resampled particles are drawn into the second particle set, which
+	// then becomes the current one
+	resampled_particles.resize(count);
+	cumulative_weights.resize(count);
+	resample_positions.resize(count);
+
+	// Running sum of the weights. Particle i is picked for every position
+	// that falls into [cumulative_weights[i - 1], cumulative_weights[i]), so
+	// with random positions in [0, total weight) the chance of being picked is
+	// proportional to the weight.
+	partial_sum(particles.weight.begin(), particles.weight.end(),
+							cumulative_weights.begin());
+	double total_weight = count > 0 ? cumulative_weights[count - 1] : 0.0;
+
+	// If every weight vanished there is nothing to prefer, keep the particles
+	if(total_weight <= 0.0)
+	{
+		return;
+	}
 
-	// Vector of weights of the particles
-	vector<double> weights;
-	for(size_t par_index = 0; par_index < particlesCopy.size(); par_index++)
+	if(kld_sampling)
 	{
-		weights.push_back(particlesCopy[par_index].weight);
+		resampled_particles.resize(drawKldParticles(total_weight));
+		particles.swap(resampled_particles);
+		weights_reset = true;
+		return;
 	}
 
-	// Object of random number engine class that generate pseudo-random numbers
-	// NOTE: http://en.cppreference.com/w/cpp/numeric/random/mersenne_twister_engine
-	mt19937 gen;
-
-	// Object for generating discrete distribution based on the weights vector
-	discrete_distribution<double> weights_dist(weights.begin(), weights.end());
-
-	// With the discrete distribution pick out particles according to their
-	// weights. The higher the weight of the particle, the higher are the chances
-	// of the particle being included multiple times.
-	// Discrete_distribution is used here to pick particles with the appropriate
-	// weights(i.e. which meet a threshold)
-	// http://www.cplusplus.com/reference/random/discrete_distribution/
-	// NOTE: Here is an example which helps with the understanding
-	//       http://coliru.stacked-crooked.com/a/3c9005a4cc0ed9d6
-	for(size_t par_index = 0; par_index < particlesCopy.size(); par_index++)
+	size_t num_copied = 0;
+	if(resampling_method == RESAMPLING_RESIDUAL)
 	{
-		// Append the particle to the new list
-		// NOTE: Calling weights_dist with the generator returns the index of one
-		//       of weights in the vector which was used to generate the distribution.
-		particles.push_back(particlesCopy[weights_dist(gen)]);
+		num_copied = copyResidualParticles(total_weight);
+		total_weight = cumulative_weights[count - 1];
 	}
+
+	size_t num_draws = count - num_copied;
+	drawResamplePositions(num_draws, total_weight);
+	selectResampledParticles(num_draws, num_copied);
+
+	// Make the resampled particles the current ones. They keep their weights
+	// for reporting, but count as equally weighted in the next update.
+	particles.swap(resampled_particles);
+	weights_reset = true;
 }
 
+// Deterministic copies of residual resampling
+size_t ParticleFilter::copyResidualParticles(double total_weight)
+{
+	size_t count = particles.size();
+	double scale = double(count) / total_weight;
+	double residual_sum = 0.0;
+	size_t num_copied = 0;
 
-// Writes particle positions to a file.
-void ParticleFilter::write(string filename)
+	for(size_t par_index = 0; par_index < count; par_index++)
+	{
+		// Expected number of copies, of which the integer part is copied now
+		double expected = particles.weight[par_index] * scale;
+		size_t copies = min(size_t(expected), count - num_copied);
+		for(size_t copy_index = 0; copy_index < copies; copy_index++)
+		{
+			resampled_particles.copyFrom(particles, par_index, num_copied++);
+		}
+
+		// The fractional part is the weight for drawing the remaining particles
+		residual_sum += expected - double(copies);
+		cumulative_weights[par_index] = residual_sum;
+	}
+
+	return num_copied;
+}
+
+// Sorted resampling positions in [0, total_weight)
+void ParticleFilter::drawResamplePositions(size_t num_draws, double total_weight)
 {
-	// Object of ofstream for writing output data
-	ofstream dataFile;
+	double spacing = num_draws > 0 ? total_weight / double(num_draws) : 0.0;
 
-	// Delete existing files because we always write at the end of the file
-	remove(filename.c_str());
+	switch(resampling_method)
+	{
+		case RESAMPLING_MULTINOMIAL:
+		{
+			// Sorted independent uniforms without sorting: the normalized running
+			// sums of exponential random variables are distributed like the order
+			// statistics of uniform draws
+			double sum = 0.0;
+			for(size_t draw = 0; draw < num_draws; draw++)
+			{
+				sum -= log(1.0 - drawUniform(RANDOM_RESAMPLE, draw));
+				resample_positions[draw] = sum;
+			}
+			sum -= log(1.0 - drawUniform(RANDOM_RESAMPLE, num_draws));
 
-	// Open the file with the filename passed in and with ios::app option set
-	// NOTE: When ios::app is set, all output operations are performed at the end
-	//       of the file.
-	dataFile.open(filename, ios::app);
+			double scale = total_weight / sum;
+			for(size_t draw = 0; draw < num_draws; draw++)
+			{
+				resample_positions[draw] *= scale;
+			}
+			break;
+		}
+		case RESAMPLING_STRATIFIED:
+		{
+			// One independent draw inside each stratum
+			for(size_t draw = 0; draw < num_draws; draw++)
+			{
+				resample_positions[draw] = (double(draw) + drawUniform(RANDOM_RESAMPLE, draw)) * spacing;
+			}
+			break;
+		}
+		case RESAMPLING_SYSTEMATIC:
+		case RESAMPLING_RESIDUAL:
+		{
+			// The same random offset inside every stratum
+			double offset = drawUniform(RANDOM_RESAMPLE, 0);
+			for(size_t draw = 0; draw < num_draws; draw++)
+			{
+				resample_positions[draw] = (double(draw) + offset) * spacing;
+			}
+			break;
+		}
+	}
+}
 
-	// Go through each particle and write the particle data into the file
-	for (int par_index = 0; par_index < num_particles; ++par_index)
+// Merge the sorted positions with the cumulative weights
+void ParticleFilter::selectResampledParticles(size_t num_draws, size_t first_slot)
+{
+	size_t last_index = particles.size() - 1;
+	size_t par_index = 0;
+
+	for(size_t draw = 0; draw < num_draws; draw++)
 	{
-		if(par_index == num_particles - 1)
+		// Advance to the particle whose interval contains the position. Zero
+		// weight particles have an empty interval and are skipped.
+		while(par_index < last_index && cumulative_weights[par_index] <= resample_positions[draw])
 		{
-			dataFile << particles[par_index].x << "," \
-							 << particles[par_index].y << "," \
-							 << particles[par_index].theta;
+			par_index++;
 		}
-		else
+
+		// Copy the drawn particle into the new set
+		resampled_particles.copyFrom(particles, par_index, first_slot + draw);
+	}
+}
+
+// KLD-sampling: draw until the particles cover the occupied bins well enough
+size_t ParticleFilter::drawKldParticles(double total_weight)
+{
+	size_t min_draws = size_t(kld_min_particles);
+	size_t max_draws = size_t(kld_max_particles);
+	size_t last_index = particles.size() - 1;
+	size_t required = min_draws;
+
+	resampled_particles.resize(max_draws);
+	kld_bins.clear();
+
+	size_t num_draws = 0;
+	while(num_draws < max_draws && num_draws < required)
+	{
+		// The sample size is not known in advance, so the particles are drawn
+		// independently by binary search in the cumulative weights
+		size_t par_index = upper_bound(cumulative_weights.begin(), cumulative_weights.end(),
+																	 total_weight * drawUniform(RANDOM_RESAMPLE, num_draws)) -
+									 cumulative_weights.begin();
+		par_index = min(par_index, last_index);
+		resampled_particles.copyFrom(particles, par_index, num_draws++);
+
+		// Every newly occupied bin raises the number of particles needed
+		if(kld_bins.insert(particles.x[par_index], particles.y[par_index],
+											 particles.theta[par_index]))
 		{
-			dataFile << particles[par_index].x << "," \
-							 << particles[par_index].y << "," \
-							 << particles[par_index].theta << "\n";
+			required = max(min_draws, kld_sample_bound(kld_bins.size(), kld_epsilon, kld_z));
 		}
 	}
 
-	// Close the file
-	dataFile.close();
+	return num_draws;
+}
+
+// Uniform random number of the given stream, time step and index
+double ParticleFilter::drawUniform(RandomStream stream, size_t index) const
+{
+	double u0, u1;
+	rng.uniform2(stream, time_step, uint32_t(index), 0, &u0, &u1);
+	return u0;
+}
+
+// Writes particle positions to a file.
+void ParticleFilter::write(string filename)
+{
+	// Write the poses as "x,y,theta" lines, replacing an existing file
+	string text;
+	write_particle_snapshot(filename, &particles.x[0], &particles.y[0], &particles.theta[0],
+													particles.size(), text);
 }
 
 // Convert the passed in vehicle co-ordinates into map co-ordinates from
 // the perspective of the particle in question
-LandmarkObs ParticleFilter::convertVehicleToMapCoords(LandmarkObs observationToConvert,
-																					 		 				Particle particle)
+LandmarkObs ParticleFilter::convertVehicleToMapCoords(const LandmarkObs &observationToConvert,
+																					 		 				size_t par_index)
 {
 	// NOTE: The observations are given in the VEHICLE'S coordinate system.
 	// 	     Your particles are located according to the MAP'S coordinate system.
@@ -358,15 +683,90 @@ LandmarkObs ParticleFilter::convertVehicleToMapCoords(LandmarkObs observationToC
 	//       implement (look at equation 3.33. The equation stays as it is.
 	//       1. http://planning.cs.uiuc.edu/node99.html
 	//       2. http://www.sunshine2k.de/articles/RotationDerivation.pdf
+	//       The cosine and sine of the heading are cached with the particle.
+	double cos_theta = particles.cos_theta[par_index];
+	double sin_theta = particles.sin_theta[par_index];
+
 	LandmarkObs convertedObservation;
 	convertedObservation.id = observationToConvert.id;
-	convertedObservation.x = particle.x + \
-													 observationToConvert.x * cos(particle.theta) - \
-													 observationToConvert.y * sin(particle.theta);
+	convertedObservation.x = particles.x[par_index] + \
+													 observationToConvert.x * cos_theta - \
+													 observationToConvert.y * sin_theta;
 
-	convertedObservation.y = particle.y + \
-													 observationToConvert.x * sin(particle.theta) + \
-													 observationToConvert.y * cos(particle.theta);
+	convertedObservation.y = particles.y[par_index] + \
+													 observationToConvert.x * sin_theta + \
+													 observationToConvert.y * cos_theta;
 
 	return convertedObservation;
 }
+
+// Remember which landmarks the given particle associated its observations with
+void ParticleFilter::recordAssociations(size_t par_index,
+																				const vector<LandmarkObs> &convertedObservations,
+																				const vector<LandmarkObs> &associatedLandmarks)
+{
+	best_id = particles.id[par_index];
+	best_associations.clear();
+	best_sense_x.clear();
+	best_sense_y.clear();
+
+	for(size_t obs_index = 0; obs_index < associatedLandmarks.size(); obs_index++)
+	{
+		best_associations.push_back(associatedLandmarks[obs_index].id);
+		best_sense_x.push_back(convertedObservations[obs_index].x);
+		best_sense_y.push_back(convertedObservations[obs_index].y);
+	}
+}
+
+// Landmark ids associated by the best particle, separated by spaces.
+// Resampling copies the id along with the particle, so every copy of the best
+// particle reports the same associations.
+string ParticleFilter::getAssociations(Particle best)
+{
+	if(best.id != best_id)
+	{
+		return "";
+	}
+
+	stringstream ss;
+	copy(best_associations.begin(), best_associations.end(),
+			 ostream_iterator<int>(ss, " "));
+	string s = ss.str();
+
+	// Get rid of the trailing space
+	return s.substr(0, s.length() > 0 ? s.length() - 1 : 0);
+}
+
+// Sensed x positions of the best particle's observations
+string ParticleFilter::getSenseX(Particle best)
+{
+	if(best.id != best_id)
+	{
+		return "";
+	}
+
+	stringstream ss;
+	copy(best_sense_x.begin(), best_sense_x.end(),
+			 ostream_iterator<double>(ss, " "));
+	string s = ss.str();
+
+	// Get rid of the trailing space
+	return s.substr(0, s.length() > 0 ? s.length() - 1 : 0);
+}
+
+// Sensed y positions of the best particle's observations
+string ParticleFilter::getSenseY(Particle best)
+{
+	if(best.id != best_id)
+	{
+		return "";
+	}
+
+	stringstream ss;
+	copy(best_sense_y.begin(), best_sense_y.end(),
+			 ostream_iterator<double>(ss, " "));
+	string s = ss.str();
+
+	// Get rid of the trailing space
+	return s.substr(0, s.length() > 0 ? s.length() - 1 : 0);
+}
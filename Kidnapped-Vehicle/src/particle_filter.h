@@ -10,39 +10,136 @@
 #define PARTICLE_FILTER_H_
 
 #include "helper_functions.h"
+#include "particle_set.h"
+#include "kld_sampling.h"
+#include "thread_pool.h"
+#include "philox.h"
 #include <math.h>
 #include <float.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <string>
 
 using namespace std;
 
-struct Particle
+// Scratch space of one thread of the update step, kept between steps so that
+// a step does not allocate
+struct ThreadScratch
 {
-	int id;
-	double x;
-	double y;
-	double theta;
-	double weight;
+	// Landmark candidates from the grid index, landmarks in sensor range,
+	// observations in map coordinates and associated landmarks of the
+	// particle being processed
+	vector<int> landmark_candidates;
+	vector<Map::single_landmark_s> predicted_landmarks;
+	vector<LandmarkObs> converted_observations;
+	vector<LandmarkObs> associated_landmarks;
+
+	// Particle with the highest log weight among those the thread updated
+	double best_log_weight;
+	size_t best_index;
+};
+
+// Algorithms resample() can draw the new particles with
+enum ResamplingMethod
+{
+	// N independent draws proportional to weight
+	RESAMPLING_MULTINOMIAL,
+	// One random offset, then N evenly spaced draws
+	RESAMPLING_SYSTEMATIC,
+	// One random draw in each of N equally weighted strata
+	RESAMPLING_STRATIFIED,
+	// floor(N * weight) deterministic copies of each particle, the remaining
+	// particles drawn systematically from the leftover weights
+	RESAMPLING_RESIDUAL
 };
 
 class ParticleFilter
 {
-	// Number of particles to draw
+	// Number of particles to draw at initialization
 	int num_particles;
 
 	// Flag, if filter is initialized
 	bool is_initialized;
 
-	// Vector of weights of all particles
-	vector<double> weights;
+	// Generator of all random numbers of the filter, and the time step its
+	// numbers are keyed by (0 at init, incremented by every prediction)
+	CounterRng rng;
+	uint64_t time_step;
+
+	// Algorithm used by resample()
+	ResamplingMethod resampling_method;
+
+	// Fraction of the number of particles the effective sample size has to
+	// drop below for resample() to resample
+	double resample_threshold;
+
+	// Effective sample size 1 / sum(w^2) of the normalized weights of the
+	// last update
+	double effective_sample_size;
+
+	// Flag, if the particles were resampled since the last update, so that
+	// their weights are to be treated as uniform
+	bool weights_reset;
+
+	// Flag, if resample() adapts the number of particles by KLD-sampling, the
+	// limits of the number of particles, and the error bound and normal
+	// quantile of the KLD sample size bound (see kld_sample_bound)
+	bool kld_sampling;
+	int kld_min_particles;
+	int kld_max_particles;
+	double kld_epsilon;
+	double kld_z;
+
+	// Histogram bins occupied by the particles drawn so far
+	KldBinSet kld_bins;
+
+	// Particles drawn by resampling, swapped with the current set afterwards
+	ParticleSet resampled_particles;
+
+	// Gaussian process noise for x, y and theta of every particle, drawn ahead
+	// of the prediction kernel
+	AlignedDoubleVec noise_x;
+	AlignedDoubleVec noise_y;
+	AlignedDoubleVec noise_theta;
+
+	// Residuals between associated landmarks and observations of all
+	// particles, observation-major (see observation_log_likelihood)
+	AlignedDoubleVec residual_x;
+	AlignedDoubleVec residual_y;
+
+	// Workers the filter stages split the particles across, and the scratch
+	// space of each of their threads
+	ThreadPool thread_pool;
+	vector<ThreadScratch> thread_scratch;
+
+	// Sums of the weights or squared weights of every chunk of particles a
+	// thread is handed at a time
+	AlignedDoubleVec chunk_sums;
+
+	// Running sum of the particle weights and the sorted positions in
+	// [0, total weight) picked by resampling
+	AlignedDoubleVec cumulative_weights;
+	AlignedDoubleVec resample_positions;
+
+	// Id of the best particle of the last update and its associations
+	// (landmark ids and sensed map positions), kept for debugging
+	int best_id;
+	vector<int> best_associations;
+	vector<double> best_sense_x;
+	vector<double> best_sense_y;
 
 public:
 	// Set of current particles
-	vector<Particle> particles;
+	ParticleSet particles;
 
 	// Constructor
 	// @param M Number of particles, whether the particle is initialized
-	ParticleFilter() : num_particles(0), is_initialized(false) {}
+	// NOTE: The number of particles needs to be tuned
+	ParticleFilter() : num_particles(200), is_initialized(false), time_step(0),
+										 resampling_method(RESAMPLING_MULTINOMIAL), resample_threshold(0.5),
+										 effective_sample_size(0.0), weights_reset(true), kld_sampling(false),
+										 kld_min_particles(0), kld_max_particles(0), kld_epsilon(0.05),
+										 kld_z(2.326), thread_scratch(1), best_id(-1) {}
 
 	// Destructor
 	~ParticleFilter() {}
@@ -56,7 +153,7 @@ public:
 	 * @param std[] Array of dimension 3 [standard deviation of x [m], standard deviation of y [m]
 	 *   standard deviation of yaw [rad]]
 	 */
-	void init(double x, double y, double theta, double std[]);
+	void init(double x, double y, double theta, const double std[]);
 
 	/*
 	 * Predicts the state for the next time step using the process model.
@@ -67,26 +164,148 @@ public:
 	 * @param velocity: Velocity of car from t to t+1 [m/s]
 	 * @param yaw_rate: Yaw rate of car from t to t+1 [rad/s]
 	 */
-	void prediction(double delta_t, double std_pos[],
+	void prediction(double delta_t, const double std_pos[],
 									double velocity, double yaw_rate);
 
 	/*
 	 * Updates the weights for each particle based on the likelihood of the
-	 * observed measurements.
+	 * observed measurements. The weights are accumulated as log weights and
+	 * normalized by log-sum-exp afterwards, which leaves both the log weights
+	 * and the weights of the particles normalized.
 	 * @param sensor_range: Range [m] of sensor
 	 * @param std_landmark[]: Array of dimension 2 [standard deviation of range [m],
 	 *   																						standard deviation of bearing [rad]]
-	 * @param observations: Vector of landmark observations
+	 * @param observations: Landmark observations (vehicle coordinates)
 	 * @param map: Map class containing map landmarks
+	 * NOTE: Apart from growing the scratch buffers on the first call (or when
+	 *       the number of observations or particles grows), a filter step
+	 *       does not allocate.
 	 */
-	void updateWeights(double sensor_range, double std_landmark[],
-										 vector<LandmarkObs> observations, Map map_landmarks);
+	void updateWeights(double sensor_range, const double std_landmark[],
+										 ConstSpan<LandmarkObs> observations, const Map &map_landmarks);
 
 	/*
-	 * Resample particles with replacement with probability proportional to weight
+	 * Resample particles with replacement with probability proportional to weight.
+	 * Only resamples if the effective sample size of the last update dropped
+	 * below the resample threshold, otherwise the weights carry over to the
+	 * next update. With KLD-sampling enabled the number of particles drawn
+	 * adapts to the spread of the particles.
 	 */
 	void resample();
 
+	/*
+	 * Seeds the random numbers of the filter (0 by default). With the same seed
+	 * and inputs the filter produces bit-identical results, whatever the
+	 * number of threads.
+	 */
+	void setSeed(uint64_t seed)
+	{
+		rng.setSeed(seed);
+	}
+
+	/*
+	 * Sets the number of particles init() draws (200 by default). Call before
+	 * init().
+	 */
+	void setNumParticles(int count)
+	{
+		num_particles = count;
+	}
+
+	/*
+	 * Enables KLD-sampling: resample() draws particles one at a time,
+	 * multinomially regardless of the resampling method, and stops once
+	 * enough particles were drawn for the number of (x, y, theta) histogram
+	 * bins they occupy. Call before init(), which reserves the buffers for the
+	 * maximum number of particles.
+	 * @param min_particles, max_particles: Limits of the number of particles
+	 * @param epsilon: Bound on the Kullback-Leibler distance between the
+	 *   particles and the posterior
+	 * @param z: Upper standard normal quantile of the probability the bound
+	 *   holds with, 2.326 for 99%
+	 */
+	void setKldSampling(int min_particles, int max_particles,
+											double epsilon = 0.05, double z = 2.326)
+	{
+		kld_sampling = true;
+		kld_min_particles = min_particles;
+		kld_max_particles = max_particles;
+		kld_epsilon = epsilon;
+		kld_z = z;
+	}
+
+	/*
+	 * Sets the histogram bin size of KLD-sampling (0.5 m and 10 degrees by
+	 * default). Larger bins lead to fewer particles.
+	 * @param size_xy: Bin edge length along x and y [m]
+	 * @param size_theta: Bin edge length along the heading [rad]
+	 */
+	void setKldBinSize(double size_xy, double size_theta)
+	{
+		kld_bins.setBinSize(size_xy, size_theta);
+	}
+
+	/*
+	 * Sets the number of threads prediction() and updateWeights() split the
+	 * particles across, the calling thread included (1 by default). The
+	 * workers persist until the next call or the filter is destroyed. Small
+	 * particle counts are processed on the calling thread only.
+	 */
+	void setNumThreads(size_t num_threads)
+	{
+		thread_pool.setNumThreads(num_threads);
+		thread_scratch.resize(thread_pool.numThreads());
+	}
+
+	/*
+	 * Enables work stealing between the threads (see ThreadPool), which helps
+	 * when the number of landmarks in range differs a lot between particles.
+	 */
+	void setWorkStealing(bool enable)
+	{
+		thread_pool.setWorkStealing(enable);
+	}
+
+	/*
+	 * Returns the current number of particles, which changes with
+	 * KLD-sampling after every resampling step.
+	 */
+	size_t particleCount() const
+	{
+		return particles.size();
+	}
+
+	/*
+	 * Sets when resample() resamples.
+	 * @param fraction: Resample once the effective sample size drops below
+	 *   this fraction of the number of particles (0.5 by default). With 1 the
+	 *   particles are resampled after every update.
+	 */
+	void setResampleThreshold(double fraction)
+	{
+		resample_threshold = fraction;
+	}
+
+	/*
+	 * Returns the effective sample size 1 / sum(w^2) of the normalized
+	 * weights of the last update.
+	 */
+	double effectiveSampleSize() const
+	{
+		return effective_sample_size;
+	}
+
+	/*
+	 * Selects the algorithm used by resample(). All of them make a single
+	 * O(N) pass over the cumulative weights; systematic and stratified
+	 * resampling add less variance than multinomial resampling.
+	 * @param method: Resampling algorithm, multinomial by default
+	 */
+	void setResamplingMethod(ResamplingMethod method)
+	{
+		resampling_method = method;
+	}
+
 	/*
 	 * Writes particle positions to a file.
 	 * @param filename: File to write particle positions to.
@@ -100,21 +319,116 @@ public:
 	{
 		return is_initialized;
 	}
+
+	/*
+	 * Returns the landmark ids the best particle of the last update associated
+	 * its observations with, separated by spaces. Empty if best is not a copy
+	 * of that particle.
+	 * @param best: Particle to report the associations for
+	 */
+	std::string getAssociations(Particle best);
+
+	/*
+	 * Returns the sensed x [m] and y [m] map positions of the observations of
+	 * the best particle of the last update, separated by spaces.
+	 * @param best: Particle to report the sensed positions for
+	 */
+	std::string getSenseX(Particle best);
+	std::string getSenseY(Particle best);
+
+	/*
+	 * The same associations and sensed positions as views of the filter's
+	 * own buffers, valid until the next update. Empty if best is not a copy
+	 * of the best particle of the last update.
+	 * @param best: Particle to report the associations for
+	 */
+	ConstSpan<int> bestAssociations(const Particle &best) const
+	{
+		return best.id == best_id ? ConstSpan<int>(best_associations) : ConstSpan<int>();
+	}
+	ConstSpan<double> bestSenseX(const Particle &best) const
+	{
+		return best.id == best_id ? ConstSpan<double>(best_sense_x) : ConstSpan<double>();
+	}
+	ConstSpan<double> bestSenseY(const Particle &best) const
+	{
+		return best.id == best_id ? ConstSpan<double>(best_sense_y) : ConstSpan<double>();
+	}
 private:
+	// Times the private stages in isolation (pf_benchmark.cpp)
+	friend class ParticleFilterBenchmark;
+
 	/*
 	 * Convert the passed in vehicle co-ordinates into map co-ordinates from
 	 * the perspective of the particle in question
 	 */
-	 LandmarkObs convertVehicleToMapCoords(LandmarkObs observationToConvert,
- 																				 Particle particle);
+	 LandmarkObs convertVehicleToMapCoords(const LandmarkObs &observationToConvert,
+ 																				 size_t par_index);
 	 /*
  	 * Finds which observations correspond to which landmark
  	 * (likely by using a nearest-neighbors data association).
  	 * @param landmarks: List of landmarks
  	 * @param observation: Current list of converted observation
+	 * @param associatedLandmarks: Receives the closest landmark per observation
  	 */
-	vector<LandmarkObs> dataAssociation(vector<Map::single_landmark_s> landmarks,
-		 																	vector<LandmarkObs> observations);
+	void dataAssociation(const vector<Map::single_landmark_s> &landmarks,
+											 const vector<LandmarkObs> &observations,
+											 vector<LandmarkObs> &associatedLandmarks);
+
+	/*
+	 * Transforms the observations into map coordinates for the given particle
+	 * and associates each with the closest landmark within sensor range.
+	 * The results are left in converted_observations and associated_landmarks
+	 * of the scratch space, the latter stays empty if no landmark is in range.
+	 */
+	void associateObservations(size_t par_index, double sensor_range,
+														 ConstSpan<LandmarkObs> observations,
+														 const Map &map_landmarks, ThreadScratch &scratch);
+
+	/*
+	 * Deterministic part of residual resampling: copies every particle
+	 * floor(N * normalized weight) times to the front of resampled_particles
+	 * and leaves the running sum of the remaining weights in
+	 * cumulative_weights.
+	 * @output Number of particles copied
+	 */
+	size_t copyResidualParticles(double total_weight);
+
+	/*
+	 * Fills resample_positions with num_draws sorted positions in
+	 * [0, total_weight) according to the resampling method.
+	 */
+	void drawResamplePositions(size_t num_draws, double total_weight);
+
+	/*
+	 * Copies the particle whose cumulative weight interval contains each
+	 * position into resampled_particles, starting at slot first_slot.
+	 */
+	void selectResampledParticles(size_t num_draws, size_t first_slot);
+
+	/*
+	 * Draws particles from the cumulative weights into resampled_particles
+	 * until the KLD sample size bound of the occupied bins is met.
+	 * @output Number of particles drawn
+	 */
+	size_t drawKldParticles(double total_weight);
+
+	/*
+	 * Returns uniform random number index in [0, 1) of a stream of the
+	 * current time step.
+	 */
+	double drawUniform(RandomStream stream, size_t index) const;
+
+	/*
+	 * Records the associations of the given particle as the best particle's
+	 * associations (see getAssociations).
+	 */
+	void recordAssociations(size_t par_index,
+													const vector<LandmarkObs> &convertedObservations,
+													const vector<LandmarkObs> &associatedLandmarks);
+
+	// Resets the best particles found by all threads
+	void clearThreadScratch();
 };
 
 
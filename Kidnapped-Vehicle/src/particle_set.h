@@ -0,0 +1,180 @@
+/*
+ * particle_set.h
+ *
+ * Structure-of-arrays storage for the particles of the 2D particle filter.
+ */
+
+#ifndef PARTICLE_SET_H_
+#define PARTICLE_SET_H_
+
+#include <stddef.h>
+#include <new>
+#include <vector>
+
+// Value type of a single particle. The filter itself never stores particles
+// in this form, it is only handed out by ParticleSet for read-only access.
+struct Particle
+{
+	int id;
+	double x;
+	double y;
+	double theta;
+	double weight;
+};
+
+// Allocator handing out memory aligned to a cache line, which is also wide
+// enough for the largest SIMD register (AVX-512).
+template <typename T, size_t Alignment = 64>
+struct AlignedAllocator
+{
+	typedef T value_type;
+
+	template <typename U>
+	struct rebind
+	{
+		typedef AlignedAllocator<U, Alignment> other;
+	};
+
+	AlignedAllocator() {}
+
+	template <typename U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	// Goes through the aligned operator new, so that replacing the global
+	// allocation functions (e.g. to count allocations) covers these buffers
+	T* allocate(size_t n)
+	{
+		return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Alignment)));
+	}
+
+	void deallocate(T *ptr, size_t)
+	{
+		::operator delete(ptr, std::align_val_t(Alignment));
+	}
+};
+
+template <typename T, typename U, size_t Alignment>
+inline bool operator==(const AlignedAllocator<T, Alignment>&,
+											 const AlignedAllocator<U, Alignment>&)
+{
+	return true;
+}
+
+template <typename T, typename U, size_t Alignment>
+inline bool operator!=(const AlignedAllocator<T, Alignment>&,
+											 const AlignedAllocator<U, Alignment>&)
+{
+	return false;
+}
+
+// Contiguous, cache line aligned array of doubles
+typedef std::vector<double, AlignedAllocator<double> > AlignedDoubleVec;
+
+/*
+ * Set of particles stored as one array per state component, so that the
+ * filter stages stream over contiguous memory and can be vectorized.
+ * Indexing the set returns a Particle by value, which keeps code written
+ * against the old vector<Particle> (best particle scan, output) working.
+ */
+class ParticleSet
+{
+public:
+	// Id of every particle
+	std::vector<int> id;
+	// Position x [m] of every particle (map coordinates)
+	AlignedDoubleVec x;
+	// Position y [m] of every particle (map coordinates)
+	AlignedDoubleVec y;
+	// Heading [rad] of every particle
+	AlignedDoubleVec theta;
+	// Cached cos(theta) and sin(theta) of every particle, kept up to date by
+	// the prediction so that transforms need no trigonometric calls
+	AlignedDoubleVec cos_theta;
+	AlignedDoubleVec sin_theta;
+	// Importance weight of every particle
+	AlignedDoubleVec weight;
+	// Natural logarithm of the importance weight of every particle, in which
+	// the filter accumulates the measurement likelihoods
+	AlignedDoubleVec log_weight;
+
+	size_t size() const
+	{
+		return x.size();
+	}
+
+	bool empty() const
+	{
+		return x.empty();
+	}
+
+	// Resizes all component arrays to hold n particles
+	void resize(size_t n)
+	{
+		id.resize(n);
+		x.resize(n);
+		y.resize(n);
+		theta.resize(n);
+		cos_theta.resize(n);
+		sin_theta.resize(n);
+		weight.resize(n);
+		log_weight.resize(n);
+	}
+
+	// Reserves storage for n particles in all component arrays
+	void reserve(size_t n)
+	{
+		id.reserve(n);
+		x.reserve(n);
+		y.reserve(n);
+		theta.reserve(n);
+		cos_theta.reserve(n);
+		sin_theta.reserve(n);
+		weight.reserve(n);
+		log_weight.reserve(n);
+	}
+
+	void clear()
+	{
+		resize(0);
+	}
+
+	// Exchanges the contents of two sets without copying particle data
+	void swap(ParticleSet &other)
+	{
+		id.swap(other.id);
+		x.swap(other.x);
+		y.swap(other.y);
+		theta.swap(other.theta);
+		cos_theta.swap(other.cos_theta);
+		sin_theta.swap(other.sin_theta);
+		weight.swap(other.weight);
+		log_weight.swap(other.log_weight);
+	}
+
+	// Copies particle src_index of the set src into slot dst_index
+	void copyFrom(const ParticleSet &src, size_t src_index, size_t dst_index)
+	{
+		id[dst_index] = src.id[src_index];
+		x[dst_index] = src.x[src_index];
+		y[dst_index] = src.y[src_index];
+		theta[dst_index] = src.theta[src_index];
+		cos_theta[dst_index] = src.cos_theta[src_index];
+		sin_theta[dst_index] = src.sin_theta[src_index];
+		weight[dst_index] = src.weight[src_index];
+		log_weight[dst_index] = src.log_weight[src_index];
+	}
+
+	// Read-only view of a single particle
+	Particle operator[](size_t index) const
+	{
+		Particle particle;
+		particle.id = id[index];
+		particle.x = x[index];
+		particle.y = y[index];
+		particle.theta = theta[index];
+		particle.weight = weight[index];
+		return particle;
+	}
+};
+
+#endif /* PARTICLE_SET_H_ */
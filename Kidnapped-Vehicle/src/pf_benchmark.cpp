@@ -0,0 +1,409 @@
+/*
+ * pf_benchmark.cpp
+ *
+ * Microbenchmarks of the particle filter stages on synthetic maps: the
+ * prediction, the weight update, the coordinate transform and data
+ * association it is built from, and resampling. Sweeps the number of
+ * particles, landmarks and observations and writes the timings as JSON.
+ *
+ * Usage: pf_benchmark [--particles 1000,10000,100000] [--landmarks 50,500,5000]
+ *                     [--observations 5,20] [--warmup 2] [--repetitions 10]
+ *                     [--threads 1] [--output file.json]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "particle_filter.h"
+#include "helper_functions.h"
+
+using namespace std;
+
+// Side of the square the landmarks are spread over [m] and sensor range [m]
+#define BENCHMARK_MAP_SIZE 300.0
+#define BENCHMARK_SENSOR_RANGE 50.0
+
+// Time between two steps [sec] and motion of the vehicle
+#define BENCHMARK_DELTA_T 0.1
+#define BENCHMARK_VELOCITY 10.0
+#define BENCHMARK_YAW_RATE 0.1
+
+struct BenchmarkOptions
+{
+	vector<size_t> particle_counts;
+	vector<size_t> landmark_counts;
+	vector<size_t> observation_counts;
+	int warmup;
+	int repetitions;
+	size_t num_threads;
+	string output;
+};
+
+// Timing of one kernel in one configuration
+struct BenchmarkResult
+{
+	string kernel;
+	size_t particles;
+	size_t landmarks;
+	size_t observations;
+	double ns_per_particle_min;
+	double ns_per_particle_median;
+	double ns_per_particle_mean;
+	double particles_per_second;
+};
+
+/*
+ * Runs the private stages of a filter in isolation. A friend of
+ * ParticleFilter.
+ */
+class ParticleFilterBenchmark
+{
+public:
+	ParticleFilterBenchmark(ParticleFilter &filter) : pf(filter) {}
+
+	// Transforms the observations into map coordinates for every particle
+	void convertAll(ConstSpan<LandmarkObs> observations, vector<vector<LandmarkObs> > &converted)
+	{
+		converted.resize(pf.particles.size());
+		for (size_t par_index = 0; par_index < pf.particles.size(); par_index++)
+		{
+			converted[par_index].clear();
+			for (size_t obs_index = 0; obs_index < observations.size(); obs_index++)
+			{
+				converted[par_index].push_back(pf.convertVehicleToMapCoords(observations[obs_index], par_index));
+			}
+		}
+	}
+
+	// Associates the converted observations of every particle by brute force
+	void associateAll(const vector<Map::single_landmark_s> &landmarks,
+										const vector<vector<LandmarkObs> > &converted)
+	{
+		for (size_t par_index = 0; par_index < converted.size(); par_index++)
+		{
+			pf.dataAssociation(landmarks, converted[par_index], associated);
+		}
+	}
+
+private:
+	ParticleFilter &pf;
+	vector<LandmarkObs> associated;
+};
+
+// Parses a comma separated list of counts
+static bool parse_counts(const char *text, vector<size_t> &counts)
+{
+	counts.clear();
+	while (*text != '\0')
+	{
+		char *end;
+		unsigned long count = strtoul(text, &end, 10);
+		if (end == text || count == 0)
+		{
+			return false;
+		}
+		counts.push_back(count);
+		text = *end == ',' ? end + 1 : end;
+		if (*end != ',' && *end != '\0')
+		{
+			return false;
+		}
+	}
+	return !counts.empty();
+}
+
+static bool parse_options(int argc, char **argv, BenchmarkOptions &options)
+{
+	options.particle_counts = {1000, 10000, 100000};
+	options.landmark_counts = {50, 500, 5000};
+	options.observation_counts = {5, 20};
+	options.warmup = 2;
+	options.repetitions = 10;
+	options.num_threads = 1;
+
+	for (int arg = 1; arg < argc; arg++)
+	{
+		if (arg + 1 >= argc)
+		{
+			return false;
+		}
+		const char *value = argv[++arg];
+		const char *name = argv[arg - 1];
+		bool valid = true;
+		if (strcmp(name, "--particles") == 0)
+		{
+			valid = parse_counts(value, options.particle_counts);
+		}
+		else if (strcmp(name, "--landmarks") == 0)
+		{
+			valid = parse_counts(value, options.landmark_counts);
+		}
+		else if (strcmp(name, "--observations") == 0)
+		{
+			valid = parse_counts(value, options.observation_counts);
+		}
+		else if (strcmp(name, "--warmup") == 0)
+		{
+			options.warmup = atoi(value);
+			valid = options.warmup >= 0;
+		}
+		else if (strcmp(name, "--repetitions") == 0)
+		{
+			options.repetitions = atoi(value);
+			valid = options.repetitions > 0;
+		}
+		else if (strcmp(name, "--threads") == 0)
+		{
+			options.num_threads = size_t(max(atoi(value), 1));
+		}
+		else if (strcmp(name, "--output") == 0)
+		{
+			options.output = value;
+		}
+		else
+		{
+			valid = false;
+		}
+		if (!valid)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+// Landmarks spread uniformly over the map square
+static void make_map(size_t num_landmarks, mt19937 &gen, Map &map)
+{
+	uniform_real_distribution<double> coordinate(0.0, BENCHMARK_MAP_SIZE);
+	for (size_t land_index = 0; land_index < num_landmarks; land_index++)
+	{
+		Map::single_landmark_s landmark;
+		landmark.id_i = int(land_index) + 1;
+		landmark.x_f = float(coordinate(gen));
+		landmark.y_f = float(coordinate(gen));
+		map.landmark_list.push_back(landmark);
+	}
+	map.buildGridIndex(BENCHMARK_SENSOR_RANGE);
+	map.buildKdTree();
+}
+
+/*
+ * Observations of the nearest landmarks from a vehicle pose, in vehicle
+ * coordinates, topped up with points within the sensor range if fewer
+ * landmarks are in range.
+ */
+static void make_observations(const Map &map, double x, double y, double theta,
+															size_t num_observations, mt19937 &gen,
+															vector<LandmarkObs> &observations)
+{
+	vector<pair<double, size_t> > by_distance;
+	for (size_t land_index = 0; land_index < map.landmark_list.size(); land_index++)
+	{
+		double distance = dist(x, y, map.landmark_list[land_index].x_f, map.landmark_list[land_index].y_f);
+		if (distance <= BENCHMARK_SENSOR_RANGE)
+		{
+			by_distance.push_back(make_pair(distance, land_index));
+		}
+	}
+	sort(by_distance.begin(), by_distance.end());
+
+	uniform_real_distribution<double> offset(-BENCHMARK_SENSOR_RANGE / 2.0, BENCHMARK_SENSOR_RANGE / 2.0);
+	observations.clear();
+	for (size_t obs_index = 0; obs_index < num_observations; obs_index++)
+	{
+		double map_x, map_y;
+		if (obs_index < by_distance.size())
+		{
+			map_x = map.landmark_list[by_distance[obs_index].second].x_f;
+			map_y = map.landmark_list[by_distance[obs_index].second].y_f;
+		}
+		else
+		{
+			map_x = x + offset(gen);
+			map_y = y + offset(gen);
+		}
+
+		LandmarkObs obs;
+		obs.id = 0;
+		obs.x = cos(theta) * (map_x - x) + sin(theta) * (map_y - y);
+		obs.y = -sin(theta) * (map_x - x) + cos(theta) * (map_y - y);
+		observations.push_back(obs);
+	}
+}
+
+/*
+ * Times a kernel: runs prepare and then the kernel warmup times without and
+ * repetitions times with timing, only the kernel being timed.
+ */
+template <typename Prepare, typename Kernel>
+static BenchmarkResult time_kernel(const string &kernel_name, size_t num_particles,
+																	 const BenchmarkOptions &options, Prepare prepare, Kernel kernel)
+{
+	vector<double> ns_per_particle;
+	for (int run = 0; run < options.warmup + options.repetitions; run++)
+	{
+		prepare();
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		kernel();
+		double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		if (run >= options.warmup)
+		{
+			ns_per_particle.push_back(seconds * 1e9 / double(num_particles));
+		}
+	}
+
+	sort(ns_per_particle.begin(), ns_per_particle.end());
+	BenchmarkResult result;
+	result.kernel = kernel_name;
+	result.particles = num_particles;
+	result.ns_per_particle_min = ns_per_particle.front();
+	result.ns_per_particle_median = ns_per_particle[ns_per_particle.size() / 2];
+	double total = 0.0;
+	for (size_t run = 0; run < ns_per_particle.size(); run++)
+	{
+		total += ns_per_particle[run];
+	}
+	result.ns_per_particle_mean = total / double(ns_per_particle.size());
+	result.particles_per_second = 1e9 / result.ns_per_particle_median;
+	return result;
+}
+
+static void run_configuration(size_t num_particles, size_t num_landmarks, size_t num_observations,
+															const BenchmarkOptions &options, vector<BenchmarkResult> &results)
+{
+	mt19937 gen(12345);
+	Map map;
+	make_map(num_landmarks, gen, map);
+
+	// Vehicle in the middle of the map
+	double x = BENCHMARK_MAP_SIZE / 2.0;
+	double y = BENCHMARK_MAP_SIZE / 2.0;
+	double theta = 0.3;
+	double sigma_pos[3] = {0.3, 0.3, 0.01};
+	double sigma_landmark[2] = {0.3, 0.3};
+	vector<LandmarkObs> observations;
+	make_observations(map, x, y, theta, num_observations, gen, observations);
+
+	// Landmarks in sensor range of the vehicle, as the association sees them
+	vector<Map::single_landmark_s> landmarks_in_range;
+	for (size_t land_index = 0; land_index < map.landmark_list.size(); land_index++)
+	{
+		if (dist(x, y, map.landmark_list[land_index].x_f, map.landmark_list[land_index].y_f) <=
+				BENCHMARK_SENSOR_RANGE)
+		{
+			landmarks_in_range.push_back(map.landmark_list[land_index]);
+		}
+	}
+	// The association needs at least one landmark to pick from
+	if (landmarks_in_range.empty())
+	{
+		landmarks_in_range = map.landmark_list;
+	}
+
+	ParticleFilter pf;
+	pf.setNumParticles(int(num_particles));
+	pf.setNumThreads(options.num_threads);
+	// Resample after every update, so that every timed resample does the work
+	pf.setResampleThreshold(1.0);
+	pf.init(x, y, theta, sigma_pos);
+	ParticleFilterBenchmark stages(pf);
+	vector<vector<LandmarkObs> > converted;
+
+	size_t first_result = results.size();
+	auto nothing = [] {};
+	results.push_back(time_kernel("prediction", num_particles, options, nothing, [&] {
+		pf.prediction(BENCHMARK_DELTA_T, sigma_pos, BENCHMARK_VELOCITY, BENCHMARK_YAW_RATE);
+	}));
+	// Keep the particles around the pose the observations were made from
+	pf.init(x, y, theta, sigma_pos);
+
+	results.push_back(time_kernel("updateWeights", num_particles, options, nothing, [&] {
+		pf.updateWeights(BENCHMARK_SENSOR_RANGE, sigma_landmark, observations, map);
+	}));
+	results.push_back(time_kernel("convertVehicleToMapCoords", num_particles, options, nothing, [&] {
+		stages.convertAll(observations, converted);
+	}));
+	results.push_back(time_kernel("dataAssociation", num_particles, options, nothing, [&] {
+		stages.associateAll(landmarks_in_range, converted);
+	}));
+	results.push_back(time_kernel("resample", num_particles, options, [&] {
+		pf.updateWeights(BENCHMARK_SENSOR_RANGE, sigma_landmark, observations, map);
+	}, [&] {
+		pf.resample();
+	}));
+
+	for (size_t result = first_result; result < results.size(); result++)
+	{
+		results[result].landmarks = num_landmarks;
+		results[result].observations = num_observations;
+		cerr << results[result].kernel << " particles " << num_particles << " landmarks " << num_landmarks
+				 << " observations " << num_observations << ": " << results[result].ns_per_particle_median
+				 << " ns/particle" << endl;
+	}
+}
+
+static void write_json(const BenchmarkOptions &options, const vector<BenchmarkResult> &results,
+											 FILE *file)
+{
+	fprintf(file, "{\n  \"benchmark\": \"pf_benchmark\",\n");
+	fprintf(file, "  \"threads\": %zu,\n  \"warmup\": %d,\n  \"repetitions\": %d,\n",
+					options.num_threads, options.warmup, options.repetitions);
+	fprintf(file, "  \"results\": [\n");
+	for (size_t result = 0; result < results.size(); result++)
+	{
+		const BenchmarkResult &r = results[result];
+		fprintf(file, "    {\"kernel\": \"%s\", \"particles\": %zu, \"landmarks\": %zu, \"observations\": %zu, "
+						"\"ns_per_particle_min\": %.3f, \"ns_per_particle_median\": %.3f, "
+						"\"ns_per_particle_mean\": %.3f, \"particles_per_second\": %.1f}%s\n",
+						r.kernel.c_str(), r.particles, r.landmarks, r.observations, r.ns_per_particle_min,
+						r.ns_per_particle_median, r.ns_per_particle_mean, r.particles_per_second,
+						result + 1 < results.size() ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+}
+
+int main(int argc, char **argv)
+{
+	BenchmarkOptions options;
+	if (!parse_options(argc, argv, options))
+	{
+		cerr << "Usage: pf_benchmark [--particles N,...] [--landmarks N,...] [--observations N,...]\n"
+						"                    [--warmup N] [--repetitions N] [--threads N] [--output file.json]"
+				 << endl;
+		return -1;
+	}
+
+	vector<BenchmarkResult> results;
+	for (size_t particles : options.particle_counts)
+	{
+		for (size_t landmarks : options.landmark_counts)
+		{
+			for (size_t observations : options.observation_counts)
+			{
+				run_configuration(particles, landmarks, observations, options, results);
+			}
+		}
+	}
+
+	FILE *file = options.output.empty() ? stdout : fopen(options.output.c_str(), "w");
+	if (file == NULL)
+	{
+		cerr << "Error: Could not create " << options.output << endl;
+		return -1;
+	}
+	write_json(options, results, file);
+	if (file != stdout && fclose(file) != 0)
+	{
+		cerr << "Error: Could not write " << options.output << endl;
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,198 @@
+/*
+ * philox.h
+ *
+ * Counter-based random number generation with Philox4x32-10 (Salmon et al.,
+ * "Parallel Random Numbers: As Easy as 1, 2, 3"). Every random block is a
+ * pure function of a key and a counter, so the filter can derive the numbers
+ * of a particle from (seed, step, particle) without any shared generator
+ * state, and gets the same numbers whatever thread processes the particle.
+ */
+
+#ifndef PHILOX_H_
+#define PHILOX_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#include "simd_math.h"
+
+// Multipliers and key increments (Weyl sequence) of Philox4x32
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+/*
+ * Philox4x32 with 10 rounds.
+ * @param counter: Four 32-bit counter words
+ * @param key: Two 32-bit key words
+ * @output out: Four 32-bit random words
+ */
+inline void philox4x32_10(const uint32_t counter[4], const uint32_t key[2], uint32_t out[4])
+{
+	uint32_t c0 = counter[0];
+	uint32_t c1 = counter[1];
+	uint32_t c2 = counter[2];
+	uint32_t c3 = counter[3];
+	uint32_t k0 = key[0];
+	uint32_t k1 = key[1];
+
+	for (int round = 0; round < 10; round++)
+	{
+		uint64_t product0 = uint64_t(PHILOX_M0) * c0;
+		uint64_t product1 = uint64_t(PHILOX_M1) * c2;
+		c0 = uint32_t(product1 >> 32) ^ c1 ^ k0;
+		c1 = uint32_t(product1);
+		c2 = uint32_t(product0 >> 32) ^ c3 ^ k1;
+		c3 = uint32_t(product0);
+		k0 += PHILOX_W0;
+		k1 += PHILOX_W1;
+	}
+
+	out[0] = c0;
+	out[1] = c1;
+	out[2] = c2;
+	out[3] = c3;
+}
+
+#if PF_SIMD_WIDTH > 1
+/*
+ * Philox4x32 with 10 rounds on PF_SIMD_WIDTH counters at once. Every counter
+ * word sits in the low 32 bits of a 64-bit lane.
+ * @param counter: Four counter words, replaced by the random words
+ * @param key0, key1: Key words, the same for all lanes
+ */
+inline void simd_philox4x32_10(simd_uint64 counter[4], uint32_t key0, uint32_t key1)
+{
+	simd_uint64 m0 = simd_u64_set1(PHILOX_M0);
+	simd_uint64 m1 = simd_u64_set1(PHILOX_M1);
+	simd_uint64 low_mask = simd_u64_set1(0xFFFFFFFFu);
+
+	for (int round = 0; round < 10; round++)
+	{
+		simd_uint64 product0 = simd_u64_mul32(counter[0], m0);
+		simd_uint64 product1 = simd_u64_mul32(counter[2], m1);
+		counter[0] = simd_u64_xor(simd_u64_xor(simd_u64_shr(product1, 32), counter[1]),
+															simd_u64_set1(key0));
+		counter[1] = simd_u64_and(product1, low_mask);
+		counter[2] = simd_u64_xor(simd_u64_xor(simd_u64_shr(product0, 32), counter[3]),
+															simd_u64_set1(key1));
+		counter[3] = simd_u64_and(product0, low_mask);
+		key0 += PHILOX_W0;
+		key1 += PHILOX_W1;
+	}
+}
+
+/*
+ * Uniform random numbers in [0, 1) from the top 53 bits of the 64-bit words
+ * (high, low), the same numbers CounterRng::uniform2 gives.
+ */
+inline simd_double simd_philox_uniform(simd_uint64 high, simd_uint64 low)
+{
+	// The 53 bits split into 21 high and 32 low bits, each converted exactly
+	simd_uint64 top = simd_u64_shr(high, 11);
+	simd_uint64 bottom = simd_u64_or(simd_u64_shl(simd_u64_and(high, simd_u64_set1(0x7FFu)), 21),
+																	 simd_u64_shr(low, 11));
+	simd_double value = simd_fmadd(simd_u52_to_double(top), simd_set1(4294967296.0),
+																 simd_u52_to_double(bottom));
+	return simd_mul(value, simd_set1(1.0 / 9007199254740992.0));
+}
+#endif
+
+// Streams of random numbers the filter stages draw from, so that the stages
+// of one step never reuse each other's numbers
+enum RandomStream
+{
+	RANDOM_INIT,
+	RANDOM_PREDICTION,
+	RANDOM_RESAMPLE
+};
+
+/*
+ * Seeded counter-based generator. The random numbers are addressed by a
+ * stream, a step, an index (e.g. of the particle) and a block number, each
+ * address yielding two uniform or two Gaussian numbers.
+ */
+class CounterRng
+{
+public:
+	explicit CounterRng(uint64_t seed = 0)
+	{
+		setSeed(seed);
+	}
+
+	void setSeed(uint64_t seed)
+	{
+		key[0] = uint32_t(seed);
+		key[1] = uint32_t(seed >> 32);
+	}
+
+	// Key words of the seed
+	const uint32_t *keyWords() const
+	{
+		return key;
+	}
+
+	/*
+	 * Counter words of the numbers of a stream, step, index and block (see
+	 * uniform2).
+	 */
+	static void counterWords(RandomStream stream, uint64_t step, uint32_t index,
+													 uint32_t block, uint32_t counter[4])
+	{
+		counter[0] = index;
+		counter[1] = uint32_t(step);
+		counter[2] = uint32_t(step >> 32);
+		counter[3] = (uint32_t(stream) << 24) | block;
+	}
+
+	/*
+	 * Two uniform random numbers in [0, 1) with 53 random bits each.
+	 * @param stream: Stream of the filter stage drawing the numbers
+	 * @param step: Time step
+	 * @param index: Index of the particle or draw
+	 * @param block: Block number, for more than two numbers per index
+	 * @output u0, u1: Uniform random numbers
+	 */
+	void uniform2(RandomStream stream, uint64_t step, uint32_t index, uint32_t block,
+								double *u0, double *u1) const
+	{
+		uint32_t counter[4];
+		uint32_t words[4];
+		counterWords(stream, step, index, block, counter);
+		philox4x32_10(counter, key, words);
+
+		*u0 = toUniform(words[0], words[1]);
+		*u1 = toUniform(words[2], words[3]);
+	}
+
+	/*
+	 * Two independent standard normal random numbers by the Box-Muller
+	 * transform. Parameters as for uniform2.
+	 * @output n0, n1: Standard normal random numbers
+	 */
+	void normal2(RandomStream stream, uint64_t step, uint32_t index, uint32_t block,
+							 double *n0, double *n1) const
+	{
+		double u0, u1;
+		uniform2(stream, step, index, block, &u0, &u1);
+
+		// 1 - u0 lies in (0, 1], so the logarithm stays finite
+		double radius = sqrt(-2.0 * log(1.0 - u0));
+		double angle = 2.0 * M_PI * u1;
+		*n0 = radius * cos(angle);
+		*n1 = radius * sin(angle);
+	}
+
+private:
+	uint32_t key[2];
+
+	// Top 53 bits of the 64-bit word (high, low) scaled to [0, 1)
+	static double toUniform(uint32_t high, uint32_t low)
+	{
+		uint64_t bits = (uint64_t(high) << 32) | low;
+		return double(bits >> 11) * (1.0 / 9007199254740992.0);
+	}
+};
+
+#endif /* PHILOX_H_ */
@@ -0,0 +1,317 @@
+/*
+ * simd_math.h
+ *
+ * Thin wrappers around the AVX2 / AVX-512 double precision intrinsics used by
+ * the filter kernels, plus vectorized math functions built on top of them.
+ * The widest instruction set enabled at compile time is used; without AVX2
+ * PF_SIMD_WIDTH is 1 and the kernels fall back to their scalar loops.
+ */
+
+#ifndef SIMD_MATH_H_
+#define SIMD_MATH_H_
+
+#include <math.h>
+#include <stdint.h>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+// Number of doubles processed per SIMD register
+#define PF_SIMD_WIDTH 8
+typedef __m512d simd_double;
+// Register of PF_SIMD_WIDTH unsigned 64-bit integers
+typedef __m512i simd_uint64;
+#elif defined(__AVX2__)
+#include <immintrin.h>
+// Number of doubles processed per SIMD register
+#define PF_SIMD_WIDTH 4
+typedef __m256d simd_double;
+// Register of PF_SIMD_WIDTH unsigned 64-bit integers
+typedef __m256i simd_uint64;
+#else
+// Number of doubles processed per SIMD register
+#define PF_SIMD_WIDTH 1
+#endif
+
+#if PF_SIMD_WIDTH > 1
+
+// Cody-Waite split of pi/2 used for the argument reduction of sin/cos
+#define PF_PIO2_1 1.57079625129699707031E0
+#define PF_PIO2_2 7.54978941586159635335E-8
+#define PF_PIO2_3 5.39030285815811905290E-15
+
+// Adding this constant to an integral double moves its value into the low
+// mantissa bits, where it can be read as an integer
+#define PF_INT_MAGIC 6755399441055744.0
+
+// Bit pattern of 2^52. ORed into an integer below 2^52 it gives the double
+// 2^52 + integer.
+#define PF_TWO52_BITS 0x4330000000000000ULL
+#define PF_TWO52 4503599627370496.0
+
+#if PF_SIMD_WIDTH == 8
+
+inline simd_double simd_set1(double value) { return _mm512_set1_pd(value); }
+inline simd_double simd_load(const double *ptr) { return _mm512_loadu_pd(ptr); }
+inline void simd_store(double *ptr, simd_double a) { _mm512_storeu_pd(ptr, a); }
+inline simd_double simd_add(simd_double a, simd_double b) { return _mm512_add_pd(a, b); }
+inline simd_double simd_sub(simd_double a, simd_double b) { return _mm512_sub_pd(a, b); }
+inline simd_double simd_mul(simd_double a, simd_double b) { return _mm512_mul_pd(a, b); }
+inline simd_double simd_fmadd(simd_double a, simd_double b, simd_double c) { return _mm512_fmadd_pd(a, b, c); }
+inline simd_double simd_round(simd_double a)
+{
+	return _mm512_roundscale_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+inline simd_double simd_max(simd_double a, simd_double b) { return _mm512_max_pd(a, b); }
+inline simd_double simd_min(simd_double a, simd_double b) { return _mm512_min_pd(a, b); }
+inline simd_double simd_div(simd_double a, simd_double b) { return _mm512_div_pd(a, b); }
+inline simd_double simd_sqrt(simd_double a) { return _mm512_sqrt_pd(a); }
+
+// Returns a < b ? if_less : otherwise for every lane
+inline simd_double simd_select_lt(simd_double a, simd_double b,
+																	simd_double if_less, simd_double otherwise)
+{
+	return _mm512_mask_blend_pd(_mm512_cmp_pd_mask(a, b, _CMP_LT_OQ), otherwise, if_less);
+}
+
+inline simd_uint64 simd_u64_set1(uint64_t value) { return _mm512_set1_epi64((long long)value); }
+// Returns first, first + 1, ... in the lanes
+inline simd_uint64 simd_u64_sequence(uint64_t first)
+{
+	return _mm512_add_epi64(_mm512_set1_epi64((long long)first),
+													_mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0));
+}
+inline simd_uint64 simd_u64_add(simd_uint64 a, simd_uint64 b) { return _mm512_add_epi64(a, b); }
+inline simd_uint64 simd_u64_and(simd_uint64 a, simd_uint64 b) { return _mm512_and_si512(a, b); }
+inline simd_uint64 simd_u64_or(simd_uint64 a, simd_uint64 b) { return _mm512_or_si512(a, b); }
+inline simd_uint64 simd_u64_xor(simd_uint64 a, simd_uint64 b) { return _mm512_xor_si512(a, b); }
+inline simd_uint64 simd_u64_shl(simd_uint64 a, int bits) { return _mm512_sll_epi64(a, _mm_cvtsi32_si128(bits)); }
+inline simd_uint64 simd_u64_shr(simd_uint64 a, int bits) { return _mm512_srl_epi64(a, _mm_cvtsi32_si128(bits)); }
+// Full 64-bit products of the low 32 bits of the lanes
+inline simd_uint64 simd_u64_mul32(simd_uint64 a, simd_uint64 b) { return _mm512_mul_epu32(a, b); }
+inline simd_uint64 simd_u64_from_bits(simd_double a) { return _mm512_castpd_si512(a); }
+inline simd_double simd_double_from_bits(simd_uint64 a) { return _mm512_castsi512_pd(a); }
+
+// Returns 2^n for integral n in [-1022, 1023]
+inline simd_double simd_pow2i(simd_double n)
+{
+	__m512i ni = _mm512_castpd_si512(_mm512_add_pd(n, _mm512_set1_pd(PF_INT_MAGIC)));
+	return _mm512_castsi512_pd(_mm512_slli_epi64(_mm512_add_epi64(ni, _mm512_set1_epi64(1023)), 52));
+}
+
+// Maps sin/cos of the reduced argument back to the quadrant q
+inline void simd_sincos_quadrant(simd_double q, simd_double s, simd_double c,
+																 simd_double *sin_out, simd_double *cos_out)
+{
+	__m512i qi = _mm512_castpd_si512(_mm512_add_pd(q, _mm512_set1_pd(PF_INT_MAGIC)));
+	__m512i sign_bit = _mm512_set1_epi64((long long)0x8000000000000000ULL);
+	__mmask8 swap = _mm512_test_epi64_mask(qi, _mm512_set1_epi64(1));
+	__m512i sin_sign = _mm512_and_si512(_mm512_slli_epi64(qi, 62), sign_bit);
+	__m512i cos_sign = _mm512_and_si512(
+			_mm512_slli_epi64(_mm512_add_epi64(qi, _mm512_set1_epi64(1)), 62), sign_bit);
+
+	simd_double sin_val = _mm512_mask_blend_pd(swap, s, c);
+	simd_double cos_val = _mm512_mask_blend_pd(swap, c, s);
+	*sin_out = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(sin_val), sin_sign));
+	*cos_out = _mm512_castsi512_pd(_mm512_xor_si512(_mm512_castpd_si512(cos_val), cos_sign));
+}
+
+#else
+
+inline simd_double simd_set1(double value) { return _mm256_set1_pd(value); }
+inline simd_double simd_load(const double *ptr) { return _mm256_loadu_pd(ptr); }
+inline void simd_store(double *ptr, simd_double a) { _mm256_storeu_pd(ptr, a); }
+inline simd_double simd_add(simd_double a, simd_double b) { return _mm256_add_pd(a, b); }
+inline simd_double simd_sub(simd_double a, simd_double b) { return _mm256_sub_pd(a, b); }
+inline simd_double simd_mul(simd_double a, simd_double b) { return _mm256_mul_pd(a, b); }
+inline simd_double simd_fmadd(simd_double a, simd_double b, simd_double c)
+{
+#if defined(__FMA__)
+	return _mm256_fmadd_pd(a, b, c);
+#else
+	return _mm256_add_pd(_mm256_mul_pd(a, b), c);
+#endif
+}
+inline simd_double simd_round(simd_double a)
+{
+	return _mm256_round_pd(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+}
+inline simd_double simd_max(simd_double a, simd_double b) { return _mm256_max_pd(a, b); }
+inline simd_double simd_min(simd_double a, simd_double b) { return _mm256_min_pd(a, b); }
+inline simd_double simd_div(simd_double a, simd_double b) { return _mm256_div_pd(a, b); }
+inline simd_double simd_sqrt(simd_double a) { return _mm256_sqrt_pd(a); }
+
+// Returns a < b ? if_less : otherwise for every lane
+inline simd_double simd_select_lt(simd_double a, simd_double b,
+																	simd_double if_less, simd_double otherwise)
+{
+	return _mm256_blendv_pd(otherwise, if_less, _mm256_cmp_pd(a, b, _CMP_LT_OQ));
+}
+
+inline simd_uint64 simd_u64_set1(uint64_t value) { return _mm256_set1_epi64x((long long)value); }
+// Returns first, first + 1, ... in the lanes
+inline simd_uint64 simd_u64_sequence(uint64_t first)
+{
+	return _mm256_add_epi64(_mm256_set1_epi64x((long long)first), _mm256_set_epi64x(3, 2, 1, 0));
+}
+inline simd_uint64 simd_u64_add(simd_uint64 a, simd_uint64 b) { return _mm256_add_epi64(a, b); }
+inline simd_uint64 simd_u64_and(simd_uint64 a, simd_uint64 b) { return _mm256_and_si256(a, b); }
+inline simd_uint64 simd_u64_or(simd_uint64 a, simd_uint64 b) { return _mm256_or_si256(a, b); }
+inline simd_uint64 simd_u64_xor(simd_uint64 a, simd_uint64 b) { return _mm256_xor_si256(a, b); }
+inline simd_uint64 simd_u64_shl(simd_uint64 a, int bits) { return _mm256_sll_epi64(a, _mm_cvtsi32_si128(bits)); }
+inline simd_uint64 simd_u64_shr(simd_uint64 a, int bits) { return _mm256_srl_epi64(a, _mm_cvtsi32_si128(bits)); }
+// Full 64-bit products of the low 32 bits of the lanes
+inline simd_uint64 simd_u64_mul32(simd_uint64 a, simd_uint64 b) { return _mm256_mul_epu32(a, b); }
+inline simd_uint64 simd_u64_from_bits(simd_double a) { return _mm256_castpd_si256(a); }
+inline simd_double simd_double_from_bits(simd_uint64 a) { return _mm256_castsi256_pd(a); }
+
+// Returns 2^n for integral n in [-1022, 1023]
+inline simd_double simd_pow2i(simd_double n)
+{
+	__m256i ni = _mm256_castpd_si256(_mm256_add_pd(n, _mm256_set1_pd(PF_INT_MAGIC)));
+	return _mm256_castsi256_pd(_mm256_slli_epi64(_mm256_add_epi64(ni, _mm256_set1_epi64x(1023)), 52));
+}
+
+// Maps sin/cos of the reduced argument back to the quadrant q
+inline void simd_sincos_quadrant(simd_double q, simd_double s, simd_double c,
+																 simd_double *sin_out, simd_double *cos_out)
+{
+	__m256i qi = _mm256_castpd_si256(_mm256_add_pd(q, _mm256_set1_pd(PF_INT_MAGIC)));
+	__m256i sign_bit = _mm256_set1_epi64x((long long)0x8000000000000000ULL);
+	simd_double swap = _mm256_castsi256_pd(_mm256_slli_epi64(qi, 63));
+	__m256i sin_sign = _mm256_and_si256(_mm256_slli_epi64(qi, 62), sign_bit);
+	__m256i cos_sign = _mm256_and_si256(
+			_mm256_slli_epi64(_mm256_add_epi64(qi, _mm256_set1_epi64x(1)), 62), sign_bit);
+
+	simd_double sin_val = _mm256_blendv_pd(s, c, swap);
+	simd_double cos_val = _mm256_blendv_pd(c, s, swap);
+	*sin_out = _mm256_xor_pd(sin_val, _mm256_castsi256_pd(sin_sign));
+	*cos_out = _mm256_xor_pd(cos_val, _mm256_castsi256_pd(cos_sign));
+}
+
+#endif
+
+/*
+ * Computes sine and cosine of every lane of a. The argument is reduced to
+ * [-pi/4, pi/4] and evaluated with the Cephes minimax polynomials, which is
+ * accurate to a few ulp for the angles a vehicle heading takes.
+ * @param a Angles [rad]
+ * @output sin_out, cos_out Sine and cosine of a
+ */
+inline void simd_sincos(simd_double a, simd_double *sin_out, simd_double *cos_out)
+{
+	// Quadrant and reduced argument r = a - q * pi/2
+	simd_double q = simd_round(simd_mul(a, simd_set1(M_2_PI)));
+	simd_double r = simd_fmadd(q, simd_set1(-PF_PIO2_1), a);
+	r = simd_fmadd(q, simd_set1(-PF_PIO2_2), r);
+	r = simd_fmadd(q, simd_set1(-PF_PIO2_3), r);
+	simd_double z = simd_mul(r, r);
+
+	// sin(r) = r + r * z * P(z)
+	simd_double ps = simd_set1(1.58962301576546568060E-10);
+	ps = simd_fmadd(ps, z, simd_set1(-2.50507477628578072866E-8));
+	ps = simd_fmadd(ps, z, simd_set1(2.75573136213857245213E-6));
+	ps = simd_fmadd(ps, z, simd_set1(-1.98412698295895385996E-4));
+	ps = simd_fmadd(ps, z, simd_set1(8.33333333332211858878E-3));
+	ps = simd_fmadd(ps, z, simd_set1(-1.66666666666666307295E-1));
+	simd_double s = simd_fmadd(simd_mul(r, z), ps, r);
+
+	// cos(r) = 1 - z / 2 + z * z * Q(z)
+	simd_double pc = simd_set1(-1.13585365213876817300E-11);
+	pc = simd_fmadd(pc, z, simd_set1(2.08757008419747316778E-9));
+	pc = simd_fmadd(pc, z, simd_set1(-2.75573141792967388112E-7));
+	pc = simd_fmadd(pc, z, simd_set1(2.48015872888517045348E-5));
+	pc = simd_fmadd(pc, z, simd_set1(-1.38888888888730564116E-3));
+	pc = simd_fmadd(pc, z, simd_set1(4.16666666666665929218E-2));
+	simd_double c = simd_fmadd(simd_mul(z, z), pc,
+														 simd_fmadd(z, simd_set1(-0.5), simd_set1(1.0)));
+
+	simd_sincos_quadrant(q, s, c, sin_out, cos_out);
+}
+
+/*
+ * Computes e^a of every lane of a with the Cephes rational approximation.
+ * Arguments below -708 (where the result leaves the normal range) are clamped,
+ * so the result never becomes zero or denormal.
+ * @param a Exponents
+ * @output e^a
+ */
+inline simd_double simd_exp(simd_double a)
+{
+	a = simd_min(simd_max(a, simd_set1(-708.0)), simd_set1(709.0));
+
+	// a = n * ln(2) + r with |r| <= ln(2) / 2
+	simd_double n = simd_round(simd_mul(a, simd_set1(M_LOG2E)));
+	simd_double r = simd_fmadd(n, simd_set1(-6.93145751953125E-1), a);
+	r = simd_fmadd(n, simd_set1(-1.42860682030941723212E-6), r);
+	simd_double rr = simd_mul(r, r);
+
+	// e^r = 1 + 2 * P(r) / (Q(r) - P(r))
+	simd_double p = simd_set1(1.26177193074810590878E-4);
+	p = simd_fmadd(p, rr, simd_set1(3.02994407707441961300E-2));
+	p = simd_fmadd(p, rr, simd_set1(9.99999999999999999910E-1));
+	p = simd_mul(p, r);
+	simd_double q = simd_set1(3.00198505138664455042E-6);
+	q = simd_fmadd(q, rr, simd_set1(2.52448340349684104192E-3));
+	q = simd_fmadd(q, rr, simd_set1(2.27265548208155028766E-1));
+	q = simd_fmadd(q, rr, simd_set1(2.00000000000000000009E0));
+	simd_double e = simd_div(p, simd_sub(q, p));
+	e = simd_fmadd(e, simd_set1(2.0), simd_set1(1.0));
+
+	return simd_mul(e, simd_pow2i(n));
+}
+
+/*
+ * Converts integers below 2^52 to doubles (exactly).
+ * @param a Integers in [0, 2^52)
+ */
+inline simd_double simd_u52_to_double(simd_uint64 a)
+{
+	simd_double shifted = simd_double_from_bits(simd_u64_or(a, simd_u64_set1(PF_TWO52_BITS)));
+	return simd_sub(shifted, simd_set1(PF_TWO52));
+}
+
+/*
+ * Computes the natural logarithm of every lane of a with the Cephes rational
+ * approximation, accurate to about one ulp.
+ * @param a Positive, normal arguments
+ * @output ln(a)
+ */
+inline simd_double simd_log(simd_double a)
+{
+	// a = m * 2^e with the mantissa m in [0.5, 1)
+	simd_uint64 bits = simd_u64_from_bits(a);
+	simd_double e = simd_sub(simd_u52_to_double(simd_u64_shr(bits, 52)), simd_set1(1022.0));
+	simd_double m = simd_double_from_bits(
+			simd_u64_or(simd_u64_and(bits, simd_u64_set1(0x000FFFFFFFFFFFFFULL)),
+									simd_u64_set1(0x3FE0000000000000ULL)));
+
+	// Move m into [sqrt(0.5), sqrt(2)) and take x = m - 1
+	simd_double sqrt_half = simd_set1(M_SQRT1_2);
+	e = simd_sub(e, simd_select_lt(m, sqrt_half, simd_set1(1.0), simd_set1(0.0)));
+	simd_double x = simd_sub(simd_add(m, simd_select_lt(m, sqrt_half, m, simd_set1(0.0))),
+													 simd_set1(1.0));
+	simd_double z = simd_mul(x, x);
+
+	// ln(1 + x) = x - z / 2 + x * z * P(x) / Q(x)
+	simd_double p = simd_set1(1.01875663804580931796E-4);
+	p = simd_fmadd(p, x, simd_set1(4.97494994976747001425E-1));
+	p = simd_fmadd(p, x, simd_set1(4.70579119878881725854E0));
+	p = simd_fmadd(p, x, simd_set1(1.44989225341610930846E1));
+	p = simd_fmadd(p, x, simd_set1(1.79368678507819816313E1));
+	p = simd_fmadd(p, x, simd_set1(7.70838733755885391666E0));
+	simd_double q = simd_add(x, simd_set1(1.12873587189167450590E1));
+	q = simd_fmadd(q, x, simd_set1(4.52279145837532221105E1));
+	q = simd_fmadd(q, x, simd_set1(8.29875266912776603211E1));
+	q = simd_fmadd(q, x, simd_set1(7.11544750618563894466E1));
+	q = simd_fmadd(q, x, simd_set1(2.31251620126765340583E1));
+	simd_double y = simd_mul(simd_mul(x, z), simd_div(p, q));
+
+	// Add e * ln(2), split in two parts for accuracy
+	y = simd_fmadd(e, simd_set1(-2.121944400546905827679E-4), y);
+	y = simd_fmadd(z, simd_set1(-0.5), y);
+	return simd_fmadd(e, simd_set1(0.693359375), simd_add(x, y));
+}
+
+#endif /* PF_SIMD_WIDTH > 1 */
+
+#endif /* SIMD_MATH_H_ */
@@ -0,0 +1,287 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#include "snapshot_codec.h"
+
+using namespace std;
+
+// Frame modes: deltas against the preceding particle of the snapshot or
+// against the particle with the same index in the previous snapshot
+#define SNAPSHOT_FRAME_INTRA 0
+#define SNAPSHOT_FRAME_INTER 1
+
+// Headings per full turn of the 16-bit heading grid
+#define SNAPSHOT_HEADING_STEPS 65536.0
+
+// Longest variable-length integer: 64 bits in groups of 7
+#define SNAPSHOT_MAX_VARINT 10
+
+static char *put_varint(uint64_t value, char *out)
+{
+	while (value >= 0x80)
+	{
+		*out++ = char(value | 0x80);
+		value >>= 7;
+	}
+	*out++ = char(value);
+	return out;
+}
+
+static void put_varint(uint64_t value, string &out)
+{
+	char bytes[SNAPSHOT_MAX_VARINT];
+	out.append(bytes, put_varint(value, bytes));
+}
+
+static bool get_varint(const char *&cursor, const char *end, uint64_t &value)
+{
+	value = 0;
+	for (int shift = 0; shift < 64 && cursor < end; shift += 7)
+	{
+		uint8_t byte = uint8_t(*cursor++);
+		value |= uint64_t(byte & 0x7F) << shift;
+		if (byte < 0x80)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+// Maps signed deltas to unsigned ones, small magnitudes to small values
+static uint64_t zigzag(int64_t value)
+{
+	return (uint64_t(value) << 1) ^ uint64_t(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+	return int64_t(value >> 1) ^ -int64_t(value & 1);
+}
+
+static void put_double(double value, string &out)
+{
+	char bytes[sizeof(double)];
+	memcpy(bytes, &value, sizeof(double));
+	out.append(bytes, sizeof(double));
+}
+
+static bool get_double(const char *&cursor, const char *end, double &value)
+{
+	if (size_t(end - cursor) < sizeof(double))
+	{
+		return false;
+	}
+	memcpy(&value, cursor, sizeof(double));
+	cursor += sizeof(double);
+	return true;
+}
+
+// Nearest integer, with a floor that compiles to a single instruction rather
+// than a call as llround does
+static int64_t round_to_int(double value)
+{
+	return int64_t(floor(value + 0.5));
+}
+
+// Grid coordinate of a position in the previous snapshot, for inter deltas
+static int64_t predict_grid(double previous, double min, double inverse_spacing)
+{
+	return round_to_int((previous - min) * inverse_spacing);
+}
+
+SnapshotEncoder::SnapshotEncoder(double position_error)
+	: position_error(position_error)
+{
+}
+
+void SnapshotEncoder::beginArchive(string &out)
+{
+	SnapshotArchiveHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, SNAPSHOT_ARCHIVE_MAGIC, sizeof(header.magic));
+	header.version = SNAPSHOT_ARCHIVE_VERSION;
+	header.position_error = position_error;
+	out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	// A new archive starts without a previous snapshot
+	previous_x.clear();
+	previous_y.clear();
+	previous_heading.clear();
+}
+
+void SnapshotEncoder::encode(const double *x, const double *y, const double *theta, size_t count,
+														 string &out)
+{
+	double spacing = 2.0 * position_error;
+	double inverse_spacing = 1.0 / spacing;
+	double min_x = count > 0 ? *min_element(x, x + count) : 0.0;
+	double min_y = count > 0 ? *min_element(y, y + count) : 0.0;
+
+	grid_x.resize(count);
+	grid_y.resize(count);
+	heading.resize(count);
+	for (size_t par_index = 0; par_index < count; par_index++)
+	{
+		grid_x[par_index] = round_to_int((x[par_index] - min_x) * inverse_spacing);
+		grid_y[par_index] = round_to_int((y[par_index] - min_y) * inverse_spacing);
+		double turns = theta[par_index] * (0.5 / M_PI);
+		heading[par_index] = uint16_t(round_to_int((turns - floor(turns)) * SNAPSHOT_HEADING_STEPS));
+	}
+
+	// Deltas against the preceding particle, written into a buffer large
+	// enough for the longest deltas
+	intra_payload.resize(count * 3 * SNAPSHOT_MAX_VARINT);
+	char *intra_end = &intra_payload[0];
+	int64_t last_x = 0;
+	int64_t last_y = 0;
+	uint16_t last_heading = 0;
+	for (size_t par_index = 0; par_index < count; par_index++)
+	{
+		intra_end = put_varint(zigzag(grid_x[par_index] - last_x), intra_end);
+		intra_end = put_varint(zigzag(grid_y[par_index] - last_y), intra_end);
+		intra_end = put_varint(zigzag(int16_t(uint16_t(heading[par_index] - last_heading))), intra_end);
+		last_x = grid_x[par_index];
+		last_y = grid_y[par_index];
+		last_heading = heading[par_index];
+	}
+	intra_payload.resize(size_t(intra_end - intra_payload.data()));
+
+	// Deltas against the previous snapshot, if it has as many particles
+	bool inter = count > 0 && previous_x.size() == count;
+	if (inter)
+	{
+		inter_payload.resize(count * 3 * SNAPSHOT_MAX_VARINT);
+		char *inter_end = &inter_payload[0];
+		for (size_t par_index = 0; par_index < count; par_index++)
+		{
+			inter_end = put_varint(zigzag(grid_x[par_index] -
+																		predict_grid(previous_x[par_index], min_x, inverse_spacing)), inter_end);
+			inter_end = put_varint(zigzag(grid_y[par_index] -
+																		predict_grid(previous_y[par_index], min_y, inverse_spacing)), inter_end);
+			inter_end = put_varint(zigzag(int16_t(uint16_t(heading[par_index] - previous_heading[par_index]))),
+														 inter_end);
+		}
+		inter_payload.resize(size_t(inter_end - inter_payload.data()));
+		inter = inter_payload.size() < intra_payload.size();
+	}
+	const string &payload = inter ? inter_payload : intra_payload;
+
+	// The frame size covers everything after itself
+	frame_start.clear();
+	put_varint(count, frame_start);
+	frame_start.push_back(char(inter ? SNAPSHOT_FRAME_INTER : SNAPSHOT_FRAME_INTRA));
+	put_double(min_x, frame_start);
+	put_double(min_y, frame_start);
+	put_varint(frame_start.size() + payload.size(), out);
+	out.append(frame_start);
+	out.append(payload);
+
+	// Remember the snapshot as the decoder will reconstruct it
+	previous_x.resize(count);
+	previous_y.resize(count);
+	previous_heading.resize(count);
+	for (size_t par_index = 0; par_index < count; par_index++)
+	{
+		previous_x[par_index] = min_x + double(grid_x[par_index]) * spacing;
+		previous_y[par_index] = min_y + double(grid_y[par_index]) * spacing;
+		previous_heading[par_index] = heading[par_index];
+	}
+}
+
+SnapshotDecoder::SnapshotDecoder() : grid_spacing(0.0)
+{
+}
+
+bool SnapshotDecoder::beginArchive(const char *&cursor, const char *end)
+{
+	SnapshotArchiveHeader header;
+	if (size_t(end - cursor) < sizeof(header))
+	{
+		return false;
+	}
+	memcpy(&header, cursor, sizeof(header));
+	if (memcmp(header.magic, SNAPSHOT_ARCHIVE_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != SNAPSHOT_ARCHIVE_VERSION || !(header.position_error > 0.0))
+	{
+		return false;
+	}
+	cursor += sizeof(header);
+
+	grid_spacing = 2.0 * header.position_error;
+	previous_x.clear();
+	previous_y.clear();
+	previous_heading.clear();
+	return true;
+}
+
+bool SnapshotDecoder::decode(const char *&cursor, const char *end, vector<double> &x,
+														 vector<double> &y, vector<double> &theta)
+{
+	uint64_t frame_size;
+	if (!get_varint(cursor, end, frame_size) || frame_size > uint64_t(end - cursor))
+	{
+		return false;
+	}
+	const char *frame_end = cursor + frame_size;
+
+	uint64_t count;
+	double min_x, min_y;
+	if (!get_varint(cursor, frame_end, count) || cursor >= frame_end)
+	{
+		return false;
+	}
+	int mode = *cursor++;
+	// Every particle takes at least three bytes
+	if (!get_double(cursor, frame_end, min_x) || !get_double(cursor, frame_end, min_y) ||
+			count > uint64_t(frame_end - cursor) / 3 ||
+			(mode == SNAPSHOT_FRAME_INTER && previous_x.size() != count) ||
+			(mode != SNAPSHOT_FRAME_INTER && mode != SNAPSHOT_FRAME_INTRA))
+	{
+		return false;
+	}
+
+	x.resize(count);
+	y.resize(count);
+	theta.resize(count);
+	// Inter frames have as many particles as the previous one, so the
+	// headings can be replaced in place
+	previous_heading.resize(count);
+	double inverse_spacing = 1.0 / grid_spacing;
+	int64_t last_x = 0;
+	int64_t last_y = 0;
+	uint16_t last_heading = 0;
+	for (size_t par_index = 0; par_index < count; par_index++)
+	{
+		uint64_t delta_x, delta_y, delta_heading;
+		if (!get_varint(cursor, frame_end, delta_x) || !get_varint(cursor, frame_end, delta_y) ||
+				!get_varint(cursor, frame_end, delta_heading))
+		{
+			return false;
+		}
+
+		if (mode == SNAPSHOT_FRAME_INTER)
+		{
+			last_x = predict_grid(previous_x[par_index], min_x, inverse_spacing);
+			last_y = predict_grid(previous_y[par_index], min_y, inverse_spacing);
+			last_heading = previous_heading[par_index];
+		}
+		last_x += unzigzag(delta_x);
+		last_y += unzigzag(delta_y);
+		last_heading = uint16_t(last_heading + uint16_t(unzigzag(delta_heading)));
+
+		x[par_index] = min_x + double(last_x) * grid_spacing;
+		y[par_index] = min_y + double(last_y) * grid_spacing;
+		theta[par_index] = double(last_heading) * (2.0 * M_PI / SNAPSHOT_HEADING_STEPS);
+		previous_heading[par_index] = last_heading;
+	}
+	if (cursor != frame_end)
+	{
+		return false;
+	}
+
+	previous_x.assign(x.begin(), x.end());
+	previous_y.assign(y.begin(), y.end());
+	return true;
+}
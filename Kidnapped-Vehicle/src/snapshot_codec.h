@@ -0,0 +1,111 @@
+/*
+ * snapshot_codec.h
+ *
+ * Lossy compression of particle snapshots (x, y, theta of every particle)
+ * for archiving whole runs. Positions are quantized on a grid anchored at
+ * the lower corner of the bounding box of the cloud, headings to 16 bits.
+ * The grid coordinates are then delta-encoded, either against the preceding
+ * particle of the same snapshot or against the particle with the same index
+ * in the previous snapshot, whichever takes fewer bytes, and written as
+ * variable-length integers.
+ *
+ * Archive layout: SnapshotArchiveHeader, then one frame per snapshot:
+ *   varint frame size (bytes after this field), varint particle count,
+ *   mode byte, double min_x, double min_y, then per particle the varint
+ *   zigzag deltas of the x, y and heading grid coordinates.
+ */
+
+#ifndef SNAPSHOT_CODEC_H_
+#define SNAPSHOT_CODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define SNAPSHOT_ARCHIVE_MAGIC "PFSNAPZ\n"
+#define SNAPSHOT_ARCHIVE_VERSION 1
+
+struct SnapshotArchiveHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t reserved;
+	// Largest position error [m]; the grid spacing is twice as large
+	double position_error;
+};
+
+class SnapshotEncoder
+{
+public:
+	/*
+	 * @param position_error: Largest error of a decoded position [m]. Decoded
+	 *   headings lie in [0, 2 pi) and are off by at most pi / 65536.
+	 */
+	explicit SnapshotEncoder(double position_error = 0.01);
+
+	double positionError() const
+	{
+		return position_error;
+	}
+
+	/*
+	 * Appends the archive header, to start an archive.
+	 * @output out: Buffer the header is appended to
+	 */
+	void beginArchive(std::string &out);
+
+	/*
+	 * Appends a snapshot as a frame.
+	 * @param x, y, theta: Particle poses
+	 * @param count: Number of particles
+	 * @output out: Buffer the frame is appended to
+	 */
+	void encode(const double *x, const double *y, const double *theta, size_t count,
+							std::string &out);
+
+private:
+	double position_error;
+	// Previous snapshot as the decoder reconstructs it
+	std::vector<double> previous_x;
+	std::vector<double> previous_y;
+	std::vector<uint16_t> previous_heading;
+	std::vector<int64_t> grid_x;
+	std::vector<int64_t> grid_y;
+	std::vector<uint16_t> heading;
+	std::string frame_start;
+	std::string intra_payload;
+	std::string inter_payload;
+};
+
+class SnapshotDecoder
+{
+public:
+	SnapshotDecoder();
+
+	/*
+	 * Reads the archive header.
+	 * @param cursor: Start of the archive, moved past the header
+	 * @param end: End of the archive
+	 * @output False if the data is not a snapshot archive
+	 */
+	bool beginArchive(const char *&cursor, const char *end);
+
+	/*
+	 * Decodes the next frame.
+	 * @param cursor: Start of the frame, moved past it
+	 * @param end: End of the archive
+	 * @output x, y, theta: Decoded particle poses
+	 * @output False at the end of the archive or for a damaged frame
+	 */
+	bool decode(const char *&cursor, const char *end, std::vector<double> &x,
+							std::vector<double> &y, std::vector<double> &theta);
+
+private:
+	double grid_spacing;
+	std::vector<double> previous_x;
+	std::vector<double> previous_y;
+	std::vector<uint16_t> previous_heading;
+};
+
+#endif /* SNAPSHOT_CODEC_H_ */
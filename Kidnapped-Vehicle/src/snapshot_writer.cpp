@@ -0,0 +1,226 @@
+#include <stdio.h>
+#include <charconv>
+
+#include "snapshot_writer.h"
+
+using namespace std;
+
+// Longest formatted line: three numbers of at most 13 characters
+// ("-1.23457e-308"), two commas and a line break
+#define SNAPSHOT_MAX_LINE 48
+
+// Appends a number with 6 significant digits, as an ostream prints it
+static char *format_number(char *first, char *last, double value)
+{
+	return to_chars(first, last, value, chars_format::general, 6).ptr;
+}
+
+void format_particle_snapshot(const double *x, const double *y, const double *theta,
+															size_t count, string &text)
+{
+	text.resize(count * SNAPSHOT_MAX_LINE);
+	char *first = &text[0];
+	char *last = first + text.size();
+	char *cursor = first;
+
+	for (size_t par_index = 0; par_index < count; par_index++)
+	{
+		cursor = format_number(cursor, last, x[par_index]);
+		*cursor++ = ',';
+		cursor = format_number(cursor, last, y[par_index]);
+		*cursor++ = ',';
+		cursor = format_number(cursor, last, theta[par_index]);
+		// No line break after the last particle
+		if (par_index + 1 < count)
+		{
+			*cursor++ = '\n';
+		}
+	}
+	text.resize(size_t(cursor - first));
+}
+
+bool write_particle_snapshot(const string &filename, const double *x, const double *y,
+														 const double *theta, size_t count, string &text)
+{
+	format_particle_snapshot(x, y, theta, count, text);
+
+	FILE *file = fopen(filename.c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	// The text goes out in one write, without copying it into a stdio buffer
+	setvbuf(file, NULL, _IONBF, 0);
+	bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+	return fclose(file) == 0 && written;
+}
+
+SnapshotWriter::SnapshotWriter(size_t depth)
+	: slots(depth > 0 ? depth : 1), head(0), tail(0), writer_waiting(false),
+		filter_waiting(false), stopping(false), num_failed(0), archive(NULL)
+{
+	writer = thread(&SnapshotWriter::writerLoop, this);
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+	{
+		lock_guard<mutex> lock(wait_mutex);
+		stopping = true;
+	}
+	snapshot_ready.notify_one();
+	writer.join();
+
+	if (archive != NULL && fclose(archive) != 0)
+	{
+		num_failed++;
+	}
+}
+
+bool SnapshotWriter::compressTo(const string &filename, double position_error)
+{
+	// The writer only touches the archive for queued snapshots
+	flush();
+	if (archive != NULL)
+	{
+		fclose(archive);
+	}
+
+	archive = fopen(filename.c_str(), "wb");
+	if (archive == NULL)
+	{
+		return false;
+	}
+	encoder = SnapshotEncoder(position_error);
+	archive_buffer.clear();
+	encoder.beginArchive(archive_buffer);
+
+	// Write the header right away, so that an archive without snapshots is
+	// still a valid archive
+	bool written = fwrite(archive_buffer.data(), 1, archive_buffer.size(), archive) == archive_buffer.size() &&
+								 fflush(archive) == 0;
+	archive_buffer.clear();
+	if (!written)
+	{
+		fclose(archive);
+		archive = NULL;
+	}
+	return written;
+}
+
+void SnapshotWriter::submit(const string &filename, const ParticleSet &particles)
+{
+	size_t index = head.load(memory_order_relaxed);
+	if (index >= slots.size())
+	{
+		waitForSlot(index + 1 - slots.size());
+	}
+
+	// The slot is the filter thread's until head moves past it
+	Slot &slot = slots[index % slots.size()];
+	size_t count = particles.size();
+	slot.filename.assign(filename);
+	slot.x.assign(particles.x.data(), particles.x.data() + count);
+	slot.y.assign(particles.y.data(), particles.y.data() + count);
+	slot.theta.assign(particles.theta.data(), particles.theta.data() + count);
+
+	head.store(index + 1);
+	if (writer_waiting.load())
+	{
+		lock_guard<mutex> lock(wait_mutex);
+		snapshot_ready.notify_one();
+	}
+}
+
+void SnapshotWriter::flush()
+{
+	waitForSlot(head.load(memory_order_relaxed));
+}
+
+// Waits until the writer has handed back all slots before target_tail
+void SnapshotWriter::waitForSlot(size_t target_tail)
+{
+	if (tail.load() >= target_tail)
+	{
+		return;
+	}
+
+	unique_lock<mutex> lock(wait_mutex);
+	filter_waiting = true;
+	while (tail.load() < target_tail)
+	{
+		slot_free.wait(lock);
+	}
+	filter_waiting = false;
+}
+
+void SnapshotWriter::writerLoop()
+{
+	// Formatted text, reused between snapshots
+	string text;
+
+	for (;;)
+	{
+		size_t index = tail.load(memory_order_relaxed);
+		if (head.load() == index)
+		{
+			// Sleep until a snapshot arrives; exit once stopped and drained
+			unique_lock<mutex> lock(wait_mutex);
+			writer_waiting = true;
+			while (head.load() == index && !stopping.load())
+			{
+				snapshot_ready.wait(lock);
+			}
+			writer_waiting = false;
+			if (head.load() == index)
+			{
+				return;
+			}
+			continue;
+		}
+
+		writeSnapshot(slots[index % slots.size()], text);
+		// Batch the archive frames into one write per burst of snapshots. The
+		// archive is only touched while a slot is held, so compressTo can
+		// switch it between snapshots.
+		if (head.load() == index + 1)
+		{
+			flushArchive();
+		}
+
+		tail.store(index + 1);
+		if (filter_waiting.load())
+		{
+			lock_guard<mutex> lock(wait_mutex);
+			slot_free.notify_one();
+		}
+	}
+}
+
+void SnapshotWriter::writeSnapshot(Slot &slot, string &text)
+{
+	if (archive != NULL)
+	{
+		encoder.encode(slot.x.data(), slot.y.data(), slot.theta.data(), slot.x.size(),
+									 archive_buffer);
+	}
+	else if (!write_particle_snapshot(slot.filename, slot.x.data(), slot.y.data(),
+																		slot.theta.data(), slot.x.size(), text))
+	{
+		num_failed++;
+	}
+}
+
+void SnapshotWriter::flushArchive()
+{
+	if (archive == NULL || archive_buffer.empty())
+	{
+		return;
+	}
+	if (fwrite(archive_buffer.data(), 1, archive_buffer.size(), archive) != archive_buffer.size() ||
+			fflush(archive) != 0)
+	{
+		num_failed++;
+	}
+	archive_buffer.clear();
+}
@@ -0,0 +1,122 @@
+/*
+ * snapshot_writer.h
+ *
+ * Background writer of the per-step particle files used for visualization.
+ * The filter thread copies the particle poses into a ring of reusable slots
+ * and a writer thread formats and writes them, so that the filter never
+ * waits for formatting or file I/O unless the ring is full.
+ */
+
+#ifndef SNAPSHOT_WRITER_H_
+#define SNAPSHOT_WRITER_H_
+
+#include <stddef.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "particle_set.h"
+#include "snapshot_codec.h"
+
+/*
+ * Formats particle poses as "x,y,theta" lines, separated by line breaks and
+ * with the numbers printed like an ostream does (6 significant digits).
+ * @param x, y, theta: Particle poses
+ * @param count: Number of particles
+ * @output text: Formatted poses, replacing its contents
+ */
+void format_particle_snapshot(const double *x, const double *y, const double *theta,
+															size_t count, std::string &text);
+
+/*
+ * Writes particle poses to a file, replacing the file.
+ * @output True if the file could be written
+ */
+bool write_particle_snapshot(const std::string &filename, const double *x, const double *y,
+														 const double *theta, size_t count, std::string &text);
+
+class SnapshotWriter
+{
+public:
+	/*
+	 * Starts the writer thread.
+	 * @param depth: Number of snapshots that can wait for the writer
+	 */
+	explicit SnapshotWriter(size_t depth = 16);
+
+	// Writes the queued snapshots and joins the writer thread
+	~SnapshotWriter();
+
+	/*
+	 * Compresses all snapshots into one archive (see snapshot_codec.h)
+	 * instead of writing a text file per snapshot. The archive holds them in
+	 * the order they are submitted, the file names are not kept. Has to be
+	 * called before the first snapshot is submitted.
+	 * @param filename: Archive file, replaced if it exists
+	 * @param position_error: Largest error of an archived position [m]
+	 * @output True if the archive could be created
+	 */
+	bool compressTo(const std::string &filename, double position_error);
+
+	/*
+	 * Queues a copy of the particle poses for writing to a file. Waits only if
+	 * depth snapshots are queued already.
+	 * @param filename: File to write the particle poses to
+	 * @param particles: Particles
+	 */
+	void submit(const std::string &filename, const ParticleSet &particles);
+
+	// Waits until all queued snapshots are written
+	void flush();
+
+	// Number of snapshots that could not be written
+	size_t numFailed() const
+	{
+		return num_failed.load();
+	}
+
+private:
+	struct Slot
+	{
+		std::string filename;
+		std::vector<double> x;
+		std::vector<double> y;
+		std::vector<double> theta;
+	};
+
+	std::thread writer;
+	std::vector<Slot> slots;
+
+	// Single producer, single consumer ring: the filter thread fills slots
+	// [tail, head + depth) and publishes them by advancing head, the writer
+	// empties [tail, head) and hands them back by advancing tail
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+
+	// Only for sleeping while the ring is empty or full
+	std::mutex wait_mutex;
+	std::condition_variable snapshot_ready;
+	std::condition_variable slot_free;
+	std::atomic<bool> writer_waiting;
+	std::atomic<bool> filter_waiting;
+	std::atomic<bool> stopping;
+
+	std::atomic<size_t> num_failed;
+
+	// Archive of the compressed snapshots, if any. Frames collect in the
+	// buffer until the writer has caught up with the queue.
+	FILE *archive;
+	SnapshotEncoder encoder;
+	std::string archive_buffer;
+
+	void writerLoop();
+	void writeSnapshot(Slot &slot, std::string &text);
+	void flushArchive();
+	void waitForSlot(size_t target_tail);
+};
+
+#endif /* SNAPSHOT_WRITER_H_ */
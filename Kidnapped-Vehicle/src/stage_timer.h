@@ -0,0 +1,244 @@
+/*
+ * stage_timer.h
+ *
+ * Wall-clock latency of the stages of a filter step (load, predict, update,
+ * resample, estimate, write) and of whole steps, measured with a monotonic
+ * clock and kept in histograms for percentile reports.
+ */
+
+#ifndef STAGE_TIMER_H_
+#define STAGE_TIMER_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <ostream>
+
+// Stages of a filter step
+enum FilterStage
+{
+	STAGE_LOAD,
+	STAGE_PREDICT,
+	STAGE_UPDATE,
+	STAGE_RESAMPLE,
+	STAGE_ESTIMATE,
+	STAGE_WRITE,
+	NUM_FILTER_STAGES
+};
+
+// Sub-buckets per power of two of a histogram, so that a bucket spans at
+// most 1/16 (6%) of its values
+#define LATENCY_SUB_BUCKET_BITS 4
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BUCKET_BITS)
+// Powers of two of nanoseconds covered above the sub-buckets, up to 2^44 ns
+// (about 4.9 hours)
+#define LATENCY_OCTAVES 40
+
+/*
+ * Log-linear histogram of latencies in nanoseconds with a fixed number of
+ * buckets, so recording never allocates. Percentiles are reported as the
+ * upper bound of their bucket, the maximum exactly.
+ */
+class LatencyHistogram
+{
+public:
+	LatencyHistogram()
+	{
+		clear();
+	}
+
+	void clear()
+	{
+		for (int bucket = 0; bucket < NUM_BUCKETS; bucket++)
+		{
+			counts[bucket] = 0;
+		}
+		num_samples = 0;
+		max_ns = 0;
+	}
+
+	void record(uint64_t ns)
+	{
+		counts[bucketOf(ns)]++;
+		num_samples++;
+		if (ns > max_ns)
+		{
+			max_ns = ns;
+		}
+	}
+
+	uint64_t count() const
+	{
+		return num_samples;
+	}
+
+	uint64_t max() const
+	{
+		return max_ns;
+	}
+
+	/*
+	 * Returns the latency that the given fraction of the samples does not
+	 * exceed.
+	 * @param fraction: Fraction in [0, 1], e.g. 0.99 for the 99th percentile
+	 */
+	uint64_t percentile(double fraction) const
+	{
+		if (num_samples == 0)
+		{
+			return 0;
+		}
+		uint64_t rank = uint64_t(fraction * double(num_samples) + 0.5);
+		rank = rank < 1 ? 1 : (rank > num_samples ? num_samples : rank);
+
+		uint64_t seen = 0;
+		for (int bucket = 0; bucket < NUM_BUCKETS; bucket++)
+		{
+			seen += counts[bucket];
+			if (seen >= rank)
+			{
+				uint64_t upper = upperBound(bucket);
+				return upper < max_ns ? upper : max_ns;
+			}
+		}
+		return max_ns;
+	}
+
+private:
+	enum { NUM_BUCKETS = (LATENCY_OCTAVES + 1) * LATENCY_SUB_BUCKETS };
+
+	uint64_t counts[NUM_BUCKETS];
+	uint64_t num_samples;
+	uint64_t max_ns;
+
+	// Values below LATENCY_SUB_BUCKETS get a bucket each, larger ones a
+	// sub-bucket of their power of two
+	static int bucketOf(uint64_t ns)
+	{
+		if (ns < LATENCY_SUB_BUCKETS)
+		{
+			return int(ns);
+		}
+		int octave = 63 - __builtin_clzll(ns) - LATENCY_SUB_BUCKET_BITS + 1;
+		if (octave > LATENCY_OCTAVES)
+		{
+			return NUM_BUCKETS - 1;
+		}
+		int sub_bucket = int(ns >> (octave - 1)) - LATENCY_SUB_BUCKETS;
+		return octave * LATENCY_SUB_BUCKETS + sub_bucket;
+	}
+
+	// Largest value of a bucket
+	static uint64_t upperBound(int bucket)
+	{
+		int octave = bucket / LATENCY_SUB_BUCKETS;
+		uint64_t sub_bucket = uint64_t(bucket % LATENCY_SUB_BUCKETS);
+		if (octave == 0)
+		{
+			return sub_bucket;
+		}
+		return ((LATENCY_SUB_BUCKETS + sub_bucket + 1) << (octave - 1)) - 1;
+	}
+};
+
+/*
+ * Times the stages of filter steps. A step starts with startStep(); each
+ * stage() call charges the time since the previous call (or the start of
+ * the step) to a stage. A stage can be charged several times per step;
+ * endStep() records the sum of every charged stage and the latency of the
+ * whole step.
+ */
+class StageTimers
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	StageTimers()
+	{
+		for (int filter_stage = 0; filter_stage < NUM_FILTER_STAGES; filter_stage++)
+		{
+			step_ns[filter_stage] = NOT_CHARGED;
+		}
+	}
+
+	void startStep()
+	{
+		step_start = Clock::now();
+		mark = step_start;
+	}
+
+	// Charges the time since the last mark to a stage
+	void stage(FilterStage filter_stage)
+	{
+		Clock::time_point now = Clock::now();
+		uint64_t ns = nanoseconds(now - mark);
+		step_ns[filter_stage] = step_ns[filter_stage] == NOT_CHARGED ? ns : step_ns[filter_stage] + ns;
+		mark = now;
+	}
+
+	void endStep()
+	{
+		steps.record(nanoseconds(Clock::now() - step_start));
+		for (int filter_stage = 0; filter_stage < NUM_FILTER_STAGES; filter_stage++)
+		{
+			if (step_ns[filter_stage] != NOT_CHARGED)
+			{
+				stages[filter_stage].record(step_ns[filter_stage]);
+				step_ns[filter_stage] = NOT_CHARGED;
+			}
+		}
+	}
+
+	const LatencyHistogram &stageHistogram(FilterStage filter_stage) const
+	{
+		return stages[filter_stage];
+	}
+
+	const LatencyHistogram &stepHistogram() const
+	{
+		return steps;
+	}
+
+	// Prints p50, p90, p99 and max of every stage and of whole steps [us]
+	void report(std::ostream &out) const
+	{
+		static const char *names[NUM_FILTER_STAGES] = {
+			"load", "predict", "update", "resample", "estimate", "write"
+		};
+
+		out << "Stage latency [us]        p50       p90       p99       max     count" << std::endl;
+		for (int filter_stage = 0; filter_stage < NUM_FILTER_STAGES; filter_stage++)
+		{
+			reportLine(out, names[filter_stage], stages[filter_stage]);
+		}
+		reportLine(out, "step", steps);
+	}
+
+private:
+	// Marks a stage that was not entered in the current step
+	static const uint64_t NOT_CHARGED = ~uint64_t(0);
+
+	LatencyHistogram stages[NUM_FILTER_STAGES];
+	LatencyHistogram steps;
+	// Time charged to each stage in the current step
+	uint64_t step_ns[NUM_FILTER_STAGES];
+	Clock::time_point step_start;
+	Clock::time_point mark;
+
+	static uint64_t nanoseconds(Clock::duration duration)
+	{
+		return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+	}
+
+	static void reportLine(std::ostream &out, const char *name, const LatencyHistogram &histogram)
+	{
+		char line[128];
+		snprintf(line, sizeof(line), "  %-16s %9.1f %9.1f %9.1f %9.1f %9llu", name,
+						 histogram.percentile(0.5) * 1e-3, histogram.percentile(0.9) * 1e-3,
+						 histogram.percentile(0.99) * 1e-3, histogram.max() * 1e-3,
+						 (unsigned long long)histogram.count());
+		out << line << std::endl;
+	}
+};
+
+#endif /* STAGE_TIMER_H_ */
@@ -0,0 +1,173 @@
+/*
+ * text_parser.h
+ *
+ * Line-by-line parser for the whitespace separated text data files (map,
+ * control, ground truth and observation files). A file is read into a buffer
+ * in one go and its numbers are converted in place with std::from_chars,
+ * without stream objects or per-line strings.
+ */
+
+#ifndef TEXT_PARSER_H_
+#define TEXT_PARSER_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <charconv>
+#include <iostream>
+#include <string>
+
+class TextFileParser
+{
+public:
+	TextFileParser() : name(""), cursor(NULL), line_end(NULL), text_end(NULL), line_number(0), num_lines(0) {}
+
+	/*
+	 * Reads a whole file into the buffer of the calling thread, which is
+	 * reused by the next file it parses.
+	 * @param filename: Name of the file, kept for error messages, so it has
+	 *   to outlive the parser
+	 * @output True if the file could be read
+	 */
+	bool open(const std::string &filename)
+	{
+		name = filename.c_str();
+		std::string &text = buffer();
+		FILE *file = fopen(filename.c_str(), "rb");
+		if (file == NULL)
+		{
+			return false;
+		}
+
+		bool read = fseek(file, 0, SEEK_END) == 0;
+		long size = read ? ftell(file) : -1;
+		read = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+		if (read)
+		{
+			text.resize(size_t(size));
+			read = fread(&text[0], 1, text.size(), file) == text.size();
+		}
+		fclose(file);
+		if (!read)
+		{
+			return false;
+		}
+
+		cursor = text.data();
+		line_end = cursor;
+		text_end = cursor + text.size();
+		line_number = 0;
+
+		// A last line without a line break counts as well
+		num_lines = 0;
+		for (const char *line = cursor; line < text_end; line++)
+		{
+			line = static_cast<const char*>(memchr(line, '\n', size_t(text_end - line)));
+			num_lines++;
+			if (line == NULL)
+			{
+				break;
+			}
+		}
+		return true;
+	}
+
+	// Number of lines in the file, an upper bound on the number of records
+	size_t numLines() const
+	{
+		return num_lines;
+	}
+
+	/*
+	 * Moves to the next line that is not blank.
+	 * @output False at the end of the file
+	 */
+	bool nextLine()
+	{
+		for (;;)
+		{
+			if (line_end >= text_end)
+			{
+				return false;
+			}
+			// Step over the line break ending the previous line
+			cursor = line_number == 0 ? line_end : line_end + 1;
+			if (cursor >= text_end)
+			{
+				return false;
+			}
+			line_number++;
+
+			line_end = static_cast<const char*>(memchr(cursor, '\n', size_t(text_end - cursor)));
+			if (line_end == NULL)
+			{
+				line_end = text_end;
+			}
+
+			skipSpace();
+			if (cursor < line_end)
+			{
+				return true;
+			}
+		}
+	}
+
+	/*
+	 * Parses the next number of the current line. Fields after the last one
+	 * a reader asks for are ignored.
+	 * @output value: Number read
+	 * @output True if the line holds another number
+	 */
+	template <typename T>
+	bool field(T &value)
+	{
+		skipSpace();
+		std::from_chars_result result = std::from_chars(cursor, line_end, value);
+		if (result.ec != std::errc() ||
+				(result.ptr < line_end && !isSpace(*result.ptr)))
+		{
+			return false;
+		}
+		cursor = result.ptr;
+		return true;
+	}
+
+	/*
+	 * Reports a malformed line on the error output.
+	 * @param expected: Description of what the line should hold
+	 * @output Always false, for the reader to return
+	 */
+	bool error(const char *expected) const
+	{
+		std::cerr << "Error: " << name << ":" << line_number << ": expected " << expected << std::endl;
+		return false;
+	}
+
+private:
+	const char *name;
+	const char *cursor;
+	const char *line_end;
+	const char *text_end;
+	size_t line_number;
+	size_t num_lines;
+
+	static std::string &buffer()
+	{
+		static thread_local std::string text;
+		return text;
+	}
+
+	static bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	void skipSpace()
+	{
+		while (cursor < line_end && isSpace(*cursor))
+		{
+			cursor++;
+		}
+	}
+};
+
+#endif /* TEXT_PARSER_H_ */
@@ -0,0 +1,162 @@
+#include <algorithm>
+
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool()
+	: shares(1), work_stealing(false), generation(0), num_running(0),
+		stopping(false), job_function(NULL), job_body(NULL), job_count(0), job_grain(1)
+{
+}
+
+ThreadPool::~ThreadPool()
+{
+	stopWorkers();
+}
+
+void ThreadPool::setNumThreads(size_t num_threads)
+{
+	num_threads = max(num_threads, size_t(1));
+	if(num_threads == numThreads())
+	{
+		return;
+	}
+
+	stopWorkers();
+
+	// Shares are not movable, so the vector is rebuilt instead of resized
+	vector<Share, AlignedAllocator<Share> >(num_threads).swap(shares);
+
+	// No job runs now, so the workers can start from the current generation
+	stopping = false;
+	for(size_t thread_index = 1; thread_index < num_threads; thread_index++)
+	{
+		workers.push_back(thread(&ThreadPool::workerLoop, this, thread_index, generation));
+	}
+}
+
+void ThreadPool::stopWorkers()
+{
+	{
+		lock_guard<mutex> lock(job_mutex);
+		stopping = true;
+	}
+	start_signal.notify_all();
+
+	for(size_t worker = 0; worker < workers.size(); worker++)
+	{
+		workers[worker].join();
+	}
+	workers.clear();
+}
+
+// Split the range into one slice of chunks per thread and process them
+void ThreadPool::run(size_t count, size_t grain, RangeFunction function, void *body)
+{
+	grain = max(grain, size_t(1));
+	if(workers.empty() || count <= grain)
+	{
+		function(body, 0, count, 0);
+		return;
+	}
+
+	size_t num_threads = numThreads();
+	size_t num_chunks = (count + grain - 1) / grain;
+	for(size_t thread_index = 0; thread_index < num_threads; thread_index++)
+	{
+		shares[thread_index].next.store(thread_index * num_chunks / num_threads,
+																		memory_order_relaxed);
+		shares[thread_index].end = (thread_index + 1) * num_chunks / num_threads;
+	}
+
+	{
+		lock_guard<mutex> lock(job_mutex);
+		job_function = function;
+		job_body = body;
+		job_count = count;
+		job_grain = grain;
+		num_running = workers.size();
+		generation++;
+	}
+	start_signal.notify_all();
+
+	runShares(0);
+
+	unique_lock<mutex> lock(job_mutex);
+	while(num_running > 0)
+	{
+		done_signal.wait(lock);
+	}
+}
+
+// Process the own slice and, with work stealing, what is left of the others
+void ThreadPool::runShares(size_t thread_index)
+{
+	processShare(thread_index, thread_index);
+
+	if(work_stealing)
+	{
+		size_t num_threads = numThreads();
+		for(size_t offset = 1; offset < num_threads; offset++)
+		{
+			processShare((thread_index + offset) % num_threads, thread_index);
+		}
+	}
+}
+
+void ThreadPool::processShare(size_t share_index, size_t thread_index)
+{
+	Share &share = shares[share_index];
+
+	if(!work_stealing)
+	{
+		// The whole slice at once
+		size_t first = share.next.load(memory_order_relaxed);
+		if(first < share.end)
+		{
+			job_function(job_body, first * job_grain,
+									 min(share.end * job_grain, job_count), thread_index);
+		}
+		return;
+	}
+
+	// Claim one chunk at a time, competing with threads stealing from it
+	for(;;)
+	{
+		size_t chunk = share.next.fetch_add(1, memory_order_relaxed);
+		if(chunk >= share.end)
+		{
+			return;
+		}
+		job_function(job_body, chunk * job_grain,
+								 min((chunk + 1) * job_grain, job_count), thread_index);
+	}
+}
+
+void ThreadPool::workerLoop(size_t thread_index, size_t seen_generation)
+{
+	unique_lock<mutex> lock(job_mutex);
+
+	for(;;)
+	{
+		while(!stopping && generation == seen_generation)
+		{
+			start_signal.wait(lock);
+		}
+		if(stopping)
+		{
+			return;
+		}
+		seen_generation = generation;
+
+		lock.unlock();
+		runShares(thread_index);
+		lock.lock();
+
+		if(--num_running == 0)
+		{
+			done_signal.notify_one();
+		}
+	}
+}
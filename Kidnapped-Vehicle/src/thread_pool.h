@@ -0,0 +1,111 @@
+/*
+ * thread_pool.h
+ *
+ * Persistent pool of worker threads that splits index ranges (e.g. the
+ * particles of a filter stage) across the calling thread and the workers.
+ */
+
+#ifndef THREAD_POOL_H_
+#define THREAD_POOL_H_
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "particle_set.h"
+
+class ThreadPool
+{
+public:
+	// Creates a pool that runs everything on the calling thread
+	ThreadPool();
+
+	// Stops and joins the workers
+	~ThreadPool();
+
+	/*
+	 * Sets the number of threads a range is split across, the calling thread
+	 * included. Starts or stops workers, so it must not be called while a
+	 * range is processed.
+	 * @param num_threads: Number of threads, at least 1
+	 */
+	void setNumThreads(size_t num_threads);
+
+	size_t numThreads() const
+	{
+		return workers.size() + 1;
+	}
+
+	/*
+	 * Enables work stealing: threads take their slice of a range one chunk at
+	 * a time and, when done, take the remaining chunks of the other slices.
+	 * This balances ranges whose elements take differently long. Otherwise
+	 * every thread processes its slice as a single chunk.
+	 */
+	void setWorkStealing(bool enable)
+	{
+		work_stealing = enable;
+	}
+
+	/*
+	 * Calls body(begin, end, thread_index) for chunks of [0, count) across the
+	 * threads and returns once all of them are processed. Chunk boundaries
+	 * are multiples of grain, ranges of at most grain elements are processed
+	 * on the calling thread right away. thread_index is in [0, numThreads())
+	 * and can select per-thread scratch space; the calling thread has index 0.
+	 * The body must not throw.
+	 * @param count: Number of elements
+	 * @param grain: Elements per chunk
+	 * @param body: Function object processing the elements [begin, end)
+	 */
+	template <typename Body>
+	void parallelFor(size_t count, size_t grain, Body body)
+	{
+		run(count, grain, &callBody<Body>, &body);
+	}
+
+private:
+	typedef void (*RangeFunction)(void *body, size_t begin, size_t end, size_t thread_index);
+
+	// Chunks [next, end) of the slice of one thread. Each share sits on its
+	// own cache line, so that threads claiming chunks do not contend.
+	struct Share
+	{
+		std::atomic<size_t> next;
+		size_t end;
+		char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<Share, AlignedAllocator<Share> > shares;
+	bool work_stealing;
+
+	// Current job, published to the workers under the mutex
+	std::mutex job_mutex;
+	std::condition_variable start_signal;
+	std::condition_variable done_signal;
+	size_t generation;
+	size_t num_running;
+	bool stopping;
+	RangeFunction job_function;
+	void *job_body;
+	size_t job_count;
+	size_t job_grain;
+
+	template <typename Body>
+	static void callBody(void *body, size_t begin, size_t end, size_t thread_index)
+	{
+		(*static_cast<Body*>(body))(begin, end, thread_index);
+	}
+
+	void run(size_t count, size_t grain, RangeFunction function, void *body);
+	void runShares(size_t thread_index);
+	void processShare(size_t share_index, size_t thread_index);
+	void workerLoop(size_t thread_index, size_t seen_generation);
+	void stopWorkers();
+};
+
+#endif /* THREAD_POOL_H_ */
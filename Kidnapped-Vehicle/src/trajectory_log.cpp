@@ -0,0 +1,243 @@
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trajectory_log.h"
+
+using namespace std;
+
+// Size of the stdio buffer the step records collect in
+#define TRAJECTORY_LOG_BUFFER_SIZE (1 << 20)
+
+TrajectoryLogWriter::TrajectoryLogWriter()
+	: file(NULL), failed(false), offset(0)
+{
+}
+
+TrajectoryLogWriter::~TrajectoryLogWriter()
+{
+	close();
+}
+
+bool TrajectoryLogWriter::open(const string &filename)
+{
+	close();
+
+	file = fopen(filename.c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	stdio_buffer.resize(TRAJECTORY_LOG_BUFFER_SIZE);
+	setvbuf(file, &stdio_buffer[0], _IOFBF, stdio_buffer.size());
+
+	failed = false;
+	offset = 0;
+	step_offsets.clear();
+
+	TrajectoryLogHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, TRAJECTORY_LOG_MAGIC, sizeof(header.magic));
+	header.version = TRAJECTORY_LOG_VERSION;
+	header.byte_order = TRAJECTORY_LOG_BYTE_ORDER;
+	header.header_size = sizeof(TrajectoryLogHeader);
+	header.step_header_size = sizeof(TrajectoryStepHeader);
+	header.particle_size = sizeof(TrajectoryParticle);
+	writeBytes(&header, sizeof(header));
+	return !failed;
+}
+
+void TrajectoryLogWriter::append(uint64_t step, const ParticleSet &particles)
+{
+	if (file == NULL)
+	{
+		return;
+	}
+
+	size_t count = particles.size();
+	records.resize(count);
+
+	TrajectoryStepHeader step_header;
+	memset(&step_header, 0, sizeof(step_header));
+	step_header.step = step;
+	step_header.num_particles = count;
+	for (size_t par_index = 0; par_index < count; par_index++)
+	{
+		TrajectoryParticle &record = records[par_index];
+		record.x = particles.x[par_index];
+		record.y = particles.y[par_index];
+		record.theta = particles.theta[par_index];
+		record.weight = particles.weight[par_index];
+
+		if (par_index == 0 || record.weight > step_header.weight)
+		{
+			step_header.x = record.x;
+			step_header.y = record.y;
+			step_header.theta = record.theta;
+			step_header.weight = record.weight;
+		}
+	}
+
+	step_offsets.push_back(offset);
+	writeBytes(&step_header, sizeof(step_header));
+	writeBytes(records.data(), count * sizeof(TrajectoryParticle));
+}
+
+bool TrajectoryLogWriter::close()
+{
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	TrajectoryLogTrailer trailer;
+	memset(&trailer, 0, sizeof(trailer));
+	trailer.index_offset = offset;
+	trailer.num_steps = step_offsets.size();
+	memcpy(trailer.magic, TRAJECTORY_INDEX_MAGIC, sizeof(trailer.magic));
+	writeBytes(step_offsets.data(), step_offsets.size() * sizeof(uint64_t));
+	writeBytes(&trailer, sizeof(trailer));
+
+	bool written = fclose(file) == 0 && !failed;
+	file = NULL;
+	return written;
+}
+
+void TrajectoryLogWriter::writeBytes(const void *data, size_t size)
+{
+	if (size > 0 && fwrite(data, 1, size, file) != size)
+	{
+		failed = true;
+	}
+	offset += size;
+}
+
+TrajectoryLogReader::TrajectoryLogReader() : base(NULL), mapped_size(0)
+{
+}
+
+TrajectoryLogReader::~TrajectoryLogReader()
+{
+	close();
+}
+
+bool TrajectoryLogReader::open(const string &filename)
+{
+	close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0 || size_t(file_stat.st_size) < sizeof(TrajectoryLogHeader))
+	{
+		::close(fd);
+		return false;
+	}
+
+	mapped_size = size_t(file_stat.st_size);
+	void *mapping = mmap(NULL, mapped_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		mapped_size = 0;
+		return false;
+	}
+	base = static_cast<const char*>(mapping);
+
+	const TrajectoryLogHeader &header = *reinterpret_cast<const TrajectoryLogHeader*>(base);
+	if (memcmp(header.magic, TRAJECTORY_LOG_MAGIC, sizeof(header.magic)) != 0 ||
+			header.version != TRAJECTORY_LOG_VERSION ||
+			header.byte_order != TRAJECTORY_LOG_BYTE_ORDER ||
+			header.header_size != sizeof(TrajectoryLogHeader) ||
+			header.step_header_size != sizeof(TrajectoryStepHeader) ||
+			header.particle_size != sizeof(TrajectoryParticle) ||
+			!(readIndex() || scanSteps()))
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+void TrajectoryLogReader::close()
+{
+	if (base != NULL)
+	{
+		munmap(const_cast<char*>(base), mapped_size);
+		base = NULL;
+		mapped_size = 0;
+	}
+	step_offsets.clear();
+}
+
+const TrajectoryStepHeader &TrajectoryLogReader::stepHeader(size_t index) const
+{
+	return *reinterpret_cast<const TrajectoryStepHeader*>(base + step_offsets[index]);
+}
+
+ConstSpan<TrajectoryParticle> TrajectoryLogReader::particles(size_t index) const
+{
+	const char *records = base + step_offsets[index] + sizeof(TrajectoryStepHeader);
+	return ConstSpan<TrajectoryParticle>(reinterpret_cast<const TrajectoryParticle*>(records),
+																			 stepHeader(index).num_particles);
+}
+
+// Reads the index of a closed log, checking that every step lies in the file
+bool TrajectoryLogReader::readIndex()
+{
+	if (mapped_size < sizeof(TrajectoryLogHeader) + sizeof(TrajectoryLogTrailer))
+	{
+		return false;
+	}
+	const TrajectoryLogTrailer &trailer =
+		*reinterpret_cast<const TrajectoryLogTrailer*>(base + mapped_size - sizeof(TrajectoryLogTrailer));
+	uint64_t index_end = mapped_size - sizeof(TrajectoryLogTrailer);
+	if (memcmp(trailer.magic, TRAJECTORY_INDEX_MAGIC, sizeof(trailer.magic)) != 0 ||
+			trailer.index_offset > index_end ||
+			trailer.num_steps != (index_end - trailer.index_offset) / sizeof(uint64_t) ||
+			(index_end - trailer.index_offset) % sizeof(uint64_t) != 0)
+	{
+		return false;
+	}
+
+	const uint64_t *index = reinterpret_cast<const uint64_t*>(base + trailer.index_offset);
+	step_offsets.assign(index, index + trailer.num_steps);
+	for (size_t step = 0; step < step_offsets.size(); step++)
+	{
+		uint64_t step_offset = step_offsets[step];
+		if (step_offset < sizeof(TrajectoryLogHeader) || step_offset % sizeof(uint64_t) != 0 ||
+				step_offset + sizeof(TrajectoryStepHeader) > trailer.index_offset ||
+				stepHeader(step).num_particles >
+					(trailer.index_offset - step_offset - sizeof(TrajectoryStepHeader)) / sizeof(TrajectoryParticle))
+		{
+			step_offsets.clear();
+			return false;
+		}
+	}
+	return true;
+}
+
+// Rebuilds the index of a log that was not closed from its step headers,
+// dropping a last step that was cut short
+bool TrajectoryLogReader::scanSteps()
+{
+	step_offsets.clear();
+	uint64_t step_offset = sizeof(TrajectoryLogHeader);
+	while (step_offset + sizeof(TrajectoryStepHeader) <= mapped_size)
+	{
+		uint64_t num_particles = reinterpret_cast<const TrajectoryStepHeader*>(base + step_offset)->num_particles;
+		uint64_t records_offset = step_offset + sizeof(TrajectoryStepHeader);
+		if (num_particles > (mapped_size - records_offset) / sizeof(TrajectoryParticle))
+		{
+			break;
+		}
+		step_offsets.push_back(step_offset);
+		step_offset = records_offset + num_particles * sizeof(TrajectoryParticle);
+	}
+	return true;
+}
@@ -0,0 +1,167 @@
+/*
+ * trajectory_log.h
+ *
+ * Append-only binary log of the particles of every time step in one file,
+ * as an alternative to one text file per step. The file is a sequence of
+ * fixed-size records whose sizes are multiples of 8 bytes, in the byte order
+ * of the (little-endian) host, so that NumPy can map it directly (see
+ * analysis/trajectory_log.py):
+ *
+ *   TrajectoryLogHeader
+ *   per time step: TrajectoryStepHeader, then num_particles TrajectoryParticle
+ *   index: the file offset (uint64_t) of every step header
+ *   TrajectoryLogTrailer
+ *
+ * The index and trailer are written when the log is closed. A log without
+ * them, e.g. from an interrupted run, is still readable by walking the step
+ * headers.
+ */
+
+#ifndef TRAJECTORY_LOG_H_
+#define TRAJECTORY_LOG_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "helper_functions.h"
+#include "particle_set.h"
+
+#define TRAJECTORY_LOG_MAGIC "PFTRAJ\r\n"
+#define TRAJECTORY_INDEX_MAGIC "PFINDEX\n"
+#define TRAJECTORY_LOG_VERSION 1
+// Written in host byte order, so that a log from a big-endian host is
+// rejected rather than misread
+#define TRAJECTORY_LOG_BYTE_ORDER 0x01020304u
+
+struct TrajectoryLogHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	// Record sizes, the schema of the records in this version
+	uint32_t header_size;
+	uint32_t step_header_size;
+	uint32_t particle_size;
+	uint32_t reserved;
+};
+
+// Estimated pose and particle count of a time step
+struct TrajectoryStepHeader
+{
+	uint64_t step;
+	uint64_t num_particles;
+	// Pose and weight of the particle with the highest weight
+	double x;
+	double y;
+	double theta;
+	double weight;
+};
+
+struct TrajectoryParticle
+{
+	double x;
+	double y;
+	double theta;
+	double weight;
+};
+
+struct TrajectoryLogTrailer
+{
+	uint64_t index_offset;
+	uint64_t num_steps;
+	char magic[8];
+};
+
+class TrajectoryLogWriter
+{
+public:
+	TrajectoryLogWriter();
+
+	// Closes the log, writing its index
+	~TrajectoryLogWriter();
+
+	TrajectoryLogWriter(const TrajectoryLogWriter &) = delete;
+	TrajectoryLogWriter &operator=(const TrajectoryLogWriter &) = delete;
+
+	/*
+	 * Creates a log, replacing an existing file.
+	 * @param filename: Name of the log file
+	 * @output True if the file could be created
+	 */
+	bool open(const std::string &filename);
+
+	/*
+	 * Appends the particles of a time step. The records collect in a large
+	 * stdio buffer, so most steps cost a copy and no system call.
+	 * @param step: Time step
+	 * @param particles: Particles after the update of the step
+	 */
+	void append(uint64_t step, const ParticleSet &particles);
+
+	/*
+	 * Writes the index and closes the log.
+	 * @output True if all records of the log were written
+	 */
+	bool close();
+
+private:
+	FILE *file;
+	bool failed;
+	uint64_t offset;
+	std::vector<uint64_t> step_offsets;
+	// Interleaved particle records of the current step, reused between steps
+	std::vector<TrajectoryParticle> records;
+	std::vector<char> stdio_buffer;
+
+	void writeBytes(const void *data, size_t size);
+};
+
+/*
+ * Read-only, memory-mapped trajectory log with random access to the steps.
+ * The spans it returns stay valid until the log is closed or destroyed.
+ */
+class TrajectoryLogReader
+{
+public:
+	TrajectoryLogReader();
+
+	~TrajectoryLogReader();
+
+	TrajectoryLogReader(const TrajectoryLogReader &) = delete;
+	TrajectoryLogReader &operator=(const TrajectoryLogReader &) = delete;
+
+	/*
+	 * Maps a log and reads its index, or rebuilds the index if the log was
+	 * not closed.
+	 * @param filename: Name of the log file
+	 * @output True if the file is a valid log
+	 */
+	bool open(const std::string &filename);
+
+	// Unmaps the log, invalidating all spans handed out
+	void close();
+
+	// Number of time steps in the log
+	size_t numSteps() const
+	{
+		return step_offsets.size();
+	}
+
+	// Estimated pose and particle count of the index-th logged step
+	const TrajectoryStepHeader &stepHeader(size_t index) const;
+
+	// Particles of the index-th logged step
+	ConstSpan<TrajectoryParticle> particles(size_t index) const;
+
+private:
+	const char *base;
+	size_t mapped_size;
+	std::vector<uint64_t> step_offsets;
+
+	bool readIndex();
+	bool scanSteps();
+};
+
+#endif /* TRAJECTORY_LOG_H_ */
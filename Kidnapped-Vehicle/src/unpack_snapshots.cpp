@@ -0,0 +1,83 @@
+/*
+ * unpack_snapshots.cpp
+ *
+ * Expands a compressed snapshot archive (snapshot_codec.h) into the text
+ * files the visualization reads, named as the filter driver names them: the
+ * first snapshot is the initialization, the following ones the time steps.
+ *
+ * Usage: unpack_snapshots archive [output_prefix]
+ * The default prefix is "data/parfiloutput/par_filter_output".
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "snapshot_codec.h"
+#include "snapshot_writer.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+	if (argc < 2)
+	{
+		cout << "Usage: unpack_snapshots archive [output_prefix]" << endl;
+		return -1;
+	}
+	string prefix = argc > 2 ? argv[2] : "data/parfiloutput/par_filter_output";
+
+	int fd = open(argv[1], O_RDONLY);
+	struct stat file_stat;
+	if (fd < 0 || fstat(fd, &file_stat) != 0)
+	{
+		cout << "Error: Could not open archive " << argv[1] << endl;
+		return -1;
+	}
+	size_t size = size_t(file_stat.st_size);
+	void *mapping = size > 0 ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (mapping == MAP_FAILED)
+	{
+		cout << "Error: Could not read archive " << argv[1] << endl;
+		return -1;
+	}
+
+	const char *cursor = static_cast<const char*>(mapping);
+	const char *end = cursor + size;
+	SnapshotDecoder decoder;
+	if (!decoder.beginArchive(cursor, end))
+	{
+		cout << "Error: " << argv[1] << " is not a snapshot archive" << endl;
+		return -1;
+	}
+
+	vector<double> x, y, theta;
+	string text;
+	size_t num_snapshots = 0;
+	while (cursor < end)
+	{
+		if (!decoder.decode(cursor, end, x, y, theta))
+		{
+			cout << "Error: Damaged snapshot " << num_snapshots << " in " << argv[1] << endl;
+			return -1;
+		}
+
+		string filename = num_snapshots == 0 ? prefix + "_init.txt"
+																				 : prefix + to_string(num_snapshots - 1) + ".txt";
+		if (!write_particle_snapshot(filename, x.data(), y.data(), theta.data(), x.size(), text))
+		{
+			cout << "Error: Could not write " << filename << endl;
+			return -1;
+		}
+		num_snapshots++;
+	}
+
+	munmap(mapping, size);
+	cout << "Unpacked " << num_snapshots << " snapshots" << endl;
+	return 0;
+}
@@ -0,0 +1,216 @@
+/*
+ * alloc_test.cpp
+ *
+ * Checks that a filter step (prediction, updateWeights, resample) does not
+ * allocate once the first step has sized the filter's buffers. The global
+ * allocation functions are replaced by counting versions and the filter is
+ * run on a synthetic drive around a random map, in the configurations the
+ * drivers and the benchmark use.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "particle_filter.h"
+#include "helper_functions.h"
+
+using namespace std;
+
+// Side of the square the landmarks are spread over [m], number of
+// landmarks (enough for the k-d tree association path) and sensor range [m]
+#define TEST_MAP_SIZE 300.0
+#define TEST_NUM_LANDMARKS 600
+#define TEST_SENSOR_RANGE 50.0
+// Observations per step, particles and steps checked after the warm-up step
+#define TEST_NUM_OBSERVATIONS 8
+#define TEST_NUM_PARTICLES 1000
+#define TEST_NUM_STEPS 200
+// Time between steps [s] and the vehicle's circle around the map center
+#define TEST_DELTA_T 0.1
+#define TEST_VELOCITY 10.0
+#define TEST_CIRCLE_RADIUS 80.0
+
+static atomic<size_t> num_allocations(0);
+
+void *operator new(size_t size)
+{
+	num_allocations++;
+	void *ptr = malloc(size > 0 ? size : 1);
+	if (ptr == NULL)
+	{
+		throw bad_alloc();
+	}
+	return ptr;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, align_val_t alignment)
+{
+	num_allocations++;
+	void *ptr = NULL;
+	if (posix_memalign(&ptr, size_t(alignment), size > 0 ? size : 1) != 0)
+	{
+		throw bad_alloc();
+	}
+	return ptr;
+}
+
+void *operator new[](size_t size, align_val_t alignment)
+{
+	return operator new(size, alignment);
+}
+
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t) noexcept { free(ptr); }
+void operator delete(void *ptr, align_val_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, align_val_t) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t, align_val_t) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t, align_val_t) noexcept { free(ptr); }
+
+// Vehicle pose of one time step and what it observes
+struct TestStep
+{
+	double x;
+	double y;
+	double theta;
+	vector<LandmarkObs> observations;
+};
+
+// Landmarks spread uniformly over the map square
+static void make_map(mt19937 &gen, Map &map)
+{
+	uniform_real_distribution<double> coordinate(0.0, TEST_MAP_SIZE);
+	for (int land_index = 0; land_index < TEST_NUM_LANDMARKS; land_index++)
+	{
+		Map::single_landmark_s landmark;
+		landmark.id_i = land_index + 1;
+		landmark.x_f = float(coordinate(gen));
+		landmark.y_f = float(coordinate(gen));
+		map.landmark_list.push_back(landmark);
+	}
+	map.buildGridIndex(TEST_SENSOR_RANGE);
+	map.buildKdTree();
+}
+
+// Drive on a circle, observing the nearest landmarks with noise in vehicle
+// coordinates. Everything is generated before counting starts.
+static void make_drive(const Map &map, mt19937 &gen, vector<TestStep> &steps)
+{
+	normal_distribution<double> noise(0.0, 0.3);
+	double yaw_rate = TEST_VELOCITY / TEST_CIRCLE_RADIUS;
+	steps.resize(TEST_NUM_STEPS + 1);
+	for (size_t step = 0; step < steps.size(); step++)
+	{
+		double angle = yaw_rate * TEST_DELTA_T * step;
+		TestStep &pose = steps[step];
+		pose.x = TEST_MAP_SIZE / 2.0 + TEST_CIRCLE_RADIUS * sin(angle);
+		pose.y = TEST_MAP_SIZE / 2.0 - TEST_CIRCLE_RADIUS * cos(angle);
+		pose.theta = angle;
+
+		vector<pair<double, size_t> > by_distance;
+		for (size_t land_index = 0; land_index < map.landmark_list.size(); land_index++)
+		{
+			by_distance.push_back(make_pair(dist(pose.x, pose.y, map.landmark_list[land_index].x_f,
+																					 map.landmark_list[land_index].y_f), land_index));
+		}
+		sort(by_distance.begin(), by_distance.end());
+
+		for (size_t obs_index = 0; obs_index < TEST_NUM_OBSERVATIONS; obs_index++)
+		{
+			const Map::single_landmark_s &landmark = map.landmark_list[by_distance[obs_index].second];
+			double diff_x = landmark.x_f - pose.x;
+			double diff_y = landmark.y_f - pose.y;
+			LandmarkObs obs;
+			obs.id = 0;
+			obs.x = cos(pose.theta) * diff_x + sin(pose.theta) * diff_y + noise(gen);
+			obs.y = -sin(pose.theta) * diff_x + cos(pose.theta) * diff_y + noise(gen);
+			pose.observations.push_back(obs);
+		}
+	}
+}
+
+/*
+ * Runs a warm-up step and then the drive, counting the allocations of the
+ * steps after the warm-up.
+ * @param name: Name of the configuration, for the report
+ * @param pf: Configured filter, not yet initialized
+ * @output True if no step after the warm-up allocated
+ */
+static bool check_configuration(const char *name, ParticleFilter &pf, const Map &map,
+																const vector<TestStep> &steps)
+{
+	double sigma_pos[3] = {0.3, 0.3, 0.01};
+	double sigma_landmark[2] = {0.3, 0.3};
+	double yaw_rate = TEST_VELOCITY / TEST_CIRCLE_RADIUS;
+
+	pf.init(steps[0].x, steps[0].y, steps[0].theta, sigma_pos);
+	pf.updateWeights(TEST_SENSOR_RANGE, sigma_landmark, steps[0].observations, map);
+	pf.resample();
+
+	size_t before = num_allocations.load();
+	for (size_t step = 1; step < steps.size(); step++)
+	{
+		pf.prediction(TEST_DELTA_T, sigma_pos, TEST_VELOCITY, yaw_rate);
+		pf.updateWeights(TEST_SENSOR_RANGE, sigma_landmark, steps[step].observations, map);
+		pf.resample();
+	}
+	size_t allocations = num_allocations.load() - before;
+
+	printf("%-24s %zu allocations in %zu steps\n", name, allocations, steps.size() - 1);
+	return allocations == 0;
+}
+
+int main()
+{
+	mt19937 gen(12345);
+	Map map;
+	make_map(gen, map);
+	vector<TestStep> steps;
+	make_drive(map, gen, steps);
+
+	bool passed = true;
+	{
+		ParticleFilter pf;
+		pf.setNumParticles(TEST_NUM_PARTICLES);
+		passed &= check_configuration("default", pf, map, steps);
+	}
+	{
+		ParticleFilter pf;
+		pf.setNumParticles(TEST_NUM_PARTICLES);
+		pf.setResamplingMethod(RESAMPLING_RESIDUAL);
+		pf.setResampleThreshold(1.0);
+		passed &= check_configuration("residual resampling", pf, map, steps);
+	}
+	{
+		ParticleFilter pf;
+		pf.setNumParticles(TEST_NUM_PARTICLES);
+		pf.setNumThreads(4);
+		passed &= check_configuration("4 threads", pf, map, steps);
+	}
+	{
+		ParticleFilter pf;
+		pf.setNumThreads(4);
+		pf.setKldSampling(50, 2000);
+		passed &= check_configuration("KLD sampling, 4 threads", pf, map, steps);
+	}
+
+	if (!passed)
+	{
+		printf("FAILED: a filter step allocated after the warm-up step\n");
+		return 1;
+	}
+	return 0;
+}
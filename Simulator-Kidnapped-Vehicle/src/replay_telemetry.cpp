@@ -0,0 +1,163 @@
+/*
+ * replay_telemetry.cpp
+ *
+ * Headless replay of recorded simulator sessions (see particle_filter
+ * --record): pushes the recorded messages through the server's message
+ * handler without a websocket, either as fast as possible or at the pace
+ * they were recorded at, and reports the throughput and the stage latency
+ * of the last pass.
+ *
+ * Usage: replay_telemetry recording [options]
+ *   --paced            Replay at the recorded arrival times
+ *   --repeat N         Replay the session N times, each with a new filter
+ *   --map FILE         Map of the session (default ../data/map_data.txt)
+ *   --responses FILE   Write the responses of the last pass, one per line
+ *   --verbose          Print the filter output of every message
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "particle_filter.h"
+#include "telemetry_handler.h"
+#include "telemetry_recording.h"
+
+using namespace std;
+
+int main(int argc, char **argv)
+{
+	double delta_t = 0.1; // Time elapsed between measurements [sec]
+	double sensor_range = 50; // Sensor range [m]
+	double sigma_pos [3] = {0.3, 0.3, 0.01}; // GPS measurement uncertainty [x [m], y [m], theta [rad]]
+	double sigma_landmark [2] = {0.3, 0.3}; // Landmark measurement uncertainty [x [m], y [m]]
+
+	string recording_file;
+	string map_file = "../data/map_data.txt";
+	string responses_file;
+	bool paced = false;
+	bool verbose = false;
+	int repeat = 1;
+	for (int arg = 1; arg < argc; arg++)
+	{
+		if (strcmp(argv[arg], "--paced") == 0)
+		{
+			paced = true;
+		}
+		else if (strcmp(argv[arg], "--verbose") == 0)
+		{
+			verbose = true;
+		}
+		else if (strcmp(argv[arg], "--repeat") == 0 && arg + 1 < argc)
+		{
+			repeat = atoi(argv[++arg]);
+		}
+		else if (strcmp(argv[arg], "--map") == 0 && arg + 1 < argc)
+		{
+			map_file = argv[++arg];
+		}
+		else if (strcmp(argv[arg], "--responses") == 0 && arg + 1 < argc)
+		{
+			responses_file = argv[++arg];
+		}
+		else if (argv[arg][0] != '-' && recording_file.empty())
+		{
+			recording_file = argv[arg];
+		}
+		else
+		{
+			recording_file.clear();
+			break;
+		}
+	}
+	if (recording_file.empty() || repeat < 1)
+	{
+		cout << "Usage: replay_telemetry recording [--paced] [--repeat N] [--map FILE]"
+				 << " [--responses FILE] [--verbose]" << endl;
+		return -1;
+	}
+
+	vector<TelemetryMessage> messages;
+	if (!read_telemetry_recording(recording_file, messages))
+	{
+		cout << "Error: Could not read recording " << recording_file << endl;
+		return -1;
+	}
+
+	Map map;
+	if (!read_map_data(map_file, map))
+	{
+		cout << "Error: Could not open map file" << endl;
+		return -1;
+	}
+	map.buildGridIndex(sensor_range);
+	map.buildKdTree();
+
+	ofstream responses;
+	if (!responses_file.empty())
+	{
+		responses.open(responses_file);
+		if (!responses)
+		{
+			cout << "Error: Could not create " << responses_file << endl;
+			return -1;
+		}
+	}
+
+	// Response buffer of the replayed connection
+	string response;
+	size_t num_responses = 0;
+	double handling_time = 0;
+	chrono::steady_clock::time_point replay_start = chrono::steady_clock::now();
+	for (int pass = 0; pass < repeat; pass++)
+	{
+		// Every pass starts a new session, like a reconnecting simulator
+		ParticleFilter pf;
+		pf.setKldSampling(50, 2000);
+		TelemetryHandler handler(pf, map, delta_t, sensor_range, sigma_pos, sigma_landmark);
+		handler.setVerbose(verbose);
+		bool last_pass = pass + 1 == repeat;
+
+		chrono::steady_clock::time_point pass_start = chrono::steady_clock::now();
+		for (size_t index = 0; index < messages.size(); index++)
+		{
+			const TelemetryMessage &message = messages[index];
+			if (paced)
+			{
+				this_thread::sleep_until(pass_start + chrono::nanoseconds(message.arrival_ns));
+			}
+
+			chrono::steady_clock::time_point handling_start = chrono::steady_clock::now();
+			bool responded = handler.handleMessage(message.data, response);
+			handling_time += chrono::duration<double>(chrono::steady_clock::now() - handling_start).count();
+
+			if (responded)
+			{
+				num_responses++;
+				if (last_pass && responses.is_open())
+				{
+					responses << response << '\n';
+				}
+			}
+		}
+
+		if (last_pass)
+		{
+			cout << "Last pass:" << endl;
+			handler.stageTimers().report(cout);
+		}
+	}
+	double replay_time = chrono::duration<double>(chrono::steady_clock::now() - replay_start).count();
+
+	size_t num_messages = messages.size() * size_t(repeat);
+	cout << "Messages replayed: " << num_messages << " (" << num_responses << " responses)" << endl;
+	cout << "Replay time (sec): " << replay_time << endl;
+	cout << "Handling time (sec): " << handling_time << endl;
+	cout << "Messages per second: " << num_messages / handling_time << endl;
+	return 0;
+}
@@ -0,0 +1,200 @@
+#include <math.h>
+#include <string.h>
+#include <charconv>
+#include <iostream>
+
+#include "telemetry_handler.h"
+
+using namespace std;
+
+// Longest formatted numbers: an int ("-2147483648"), a number with 6
+// significant digits ("-1.23457e-308") and a JSON number with 15
+// ("-1.23456789012345e-308"), each with a separator
+#define RESPONSE_MAX_INT 12
+#define RESPONSE_MAX_SENSE 14
+#define RESPONSE_MAX_NUMBER 24
+// Keys and punctuation of the best particle response
+#define RESPONSE_MAX_TEXT 256
+
+static char *append(char *cursor, string_view text)
+{
+	memcpy(cursor, text.data(), text.size());
+	return cursor + text.size();
+}
+
+// Appends numbers separated by spaces, as the string getters of
+// ParticleFilter print them (6 significant digits)
+static char *append_list(char *cursor, char *last, ConstSpan<int> values)
+{
+	for (size_t index = 0; index < values.size(); index++)
+	{
+		if (index > 0)
+		{
+			*cursor++ = ' ';
+		}
+		cursor = to_chars(cursor, last, values[index]).ptr;
+	}
+	return cursor;
+}
+
+static char *append_list(char *cursor, char *last, ConstSpan<double> values)
+{
+	for (size_t index = 0; index < values.size(); index++)
+	{
+		if (index > 0)
+		{
+			*cursor++ = ' ';
+		}
+		cursor = to_chars(cursor, last, values[index], chars_format::general, 6).ptr;
+	}
+	return cursor;
+}
+
+// Appends a JSON number as the JSON library used to print it: 15
+// significant digits, ".0" after integral values and null if not finite
+static char *append_json_number(char *cursor, char *last, double value)
+{
+	if (!isfinite(value))
+	{
+		return append(cursor, "null");
+	}
+	char *first = cursor;
+	cursor = to_chars(cursor, last, value, chars_format::general, 15).ptr;
+	if (string_view(first, size_t(cursor - first)).find_first_of(".e") == string_view::npos)
+	{
+		cursor = append(cursor, ".0");
+	}
+	return cursor;
+}
+
+/*
+ * Formats the best_particle event for the simulator, with the keys in the
+ * order the JSON library used to sort them.
+ * @output response: Event message, replacing its contents; keeps its
+ *   capacity, so it does not allocate once it has grown
+ */
+static void format_best_particle_response(const Particle &best, ConstSpan<int> associations,
+																					ConstSpan<double> sense_x, ConstSpan<double> sense_y,
+																					string &response)
+{
+	response.resize(RESPONSE_MAX_TEXT + 3 * RESPONSE_MAX_NUMBER + associations.size() * RESPONSE_MAX_INT +
+									(sense_x.size() + sense_y.size()) * RESPONSE_MAX_SENSE);
+	char *first = &response[0];
+	char *last = first + response.size();
+	char *cursor = first;
+
+	cursor = append(cursor, "42[\"best_particle\",{\"best_particle_associations\":\"");
+	cursor = append_list(cursor, last, associations);
+	cursor = append(cursor, "\",\"best_particle_sense_x\":\"");
+	cursor = append_list(cursor, last, sense_x);
+	cursor = append(cursor, "\",\"best_particle_sense_y\":\"");
+	cursor = append_list(cursor, last, sense_y);
+	cursor = append(cursor, "\",\"best_particle_theta\":");
+	cursor = append_json_number(cursor, last, best.theta);
+	cursor = append(cursor, ",\"best_particle_x\":");
+	cursor = append_json_number(cursor, last, best.x);
+	cursor = append(cursor, ",\"best_particle_y\":");
+	cursor = append_json_number(cursor, last, best.y);
+	cursor = append(cursor, "}]");
+	response.resize(size_t(cursor - first));
+}
+
+TelemetryHandler::TelemetryHandler(ParticleFilter &pf, const Map &map, double delta_t,
+																	 double sensor_range, const double sigma_pos[3],
+																	 const double sigma_landmark[2])
+	: pf(pf), map(map), delta_t(delta_t), sensor_range(sensor_range), verbose(true)
+{
+	for (int i = 0; i < 3; i++)
+	{
+		this->sigma_pos[i] = sigma_pos[i];
+	}
+	for (int i = 0; i < 2; i++)
+	{
+		this->sigma_landmark[i] = sigma_landmark[i];
+	}
+}
+
+bool TelemetryHandler::handleMessage(string_view message, string &response)
+{
+	// "42" at the start of the message means there's a websocket message event.
+	// The 4 signifies a websocket message
+	// The 2 signifies a websocket event
+	if (message.size() <= 2 || message[0] != '4' || message[1] != '2')
+	{
+		return false;
+	}
+	stage_timers.startStep();
+
+	TelemetryMessageType type = parser.parse(message.substr(2), telemetry);
+	if (type == TELEMETRY_MANUAL)
+	{
+		response.assign("42[\"manual\",{}]");
+		return true;
+	}
+	if (type != TELEMETRY_DATA)
+	{
+		if (type == TELEMETRY_INVALID)
+		{
+			cout << "Error: Invalid simulator message" << endl;
+		}
+		return false;
+	}
+
+	// The first message initializes the filter from the noisy position, the
+	// following ones predict from the previous (noiseless) controls
+	unsigned required_fields = TELEMETRY_OBSERVATION_FIELDS |
+														 (pf.initialized() ? TELEMETRY_CONTROL_FIELDS : TELEMETRY_SENSE_FIELDS);
+	if ((telemetry.fields & required_fields) != required_fields)
+	{
+		cout << "Error: Telemetry message without the fields for a filter step" << endl;
+		return false;
+	}
+	stage_timers.stage(STAGE_LOAD);
+
+	if (!pf.initialized())
+	{
+		pf.init(telemetry.sense_x, telemetry.sense_y, telemetry.sense_theta, sigma_pos);
+	}
+	else
+	{
+		pf.prediction(delta_t, sigma_pos, telemetry.previous_velocity, telemetry.previous_yawrate);
+	}
+	stage_timers.stage(STAGE_PREDICT);
+
+	// Update the weights and resample
+	pf.updateWeights(sensor_range, sigma_landmark, telemetry.observations, map);
+	stage_timers.stage(STAGE_UPDATE);
+	pf.resample();
+	stage_timers.stage(STAGE_RESAMPLE);
+
+	// Calculate and output the average weighted error of the particle filter over all time steps so far.
+	const ParticleSet &particles = pf.particles;
+	int num_particles = particles.size();
+	double highest_weight = -1.0;
+	Particle best_particle;
+	double weight_sum = 0.0;
+	for (int i = 0; i < num_particles; ++i)
+	{
+		if (particles[i].weight > highest_weight)
+		{
+			highest_weight = particles[i].weight;
+			best_particle = particles[i];
+		}
+		weight_sum += particles[i].weight;
+	}
+	stage_timers.stage(STAGE_ESTIMATE);
+	if (verbose)
+	{
+		cout << "highest w " << highest_weight << endl;
+		cout << "average w " << weight_sum/num_particles << endl;
+		cout << "particles " << num_particles << endl;
+	}
+
+	// The best particle's pose, and its associations and sensed positions for
+	// debugging
+	format_best_particle_response(best_particle, pf.bestAssociations(best_particle),
+																pf.bestSenseX(best_particle), pf.bestSenseY(best_particle), response);
+	stage_timers.stage(STAGE_WRITE);
+	stage_timers.endStep();
+	return true;
+}
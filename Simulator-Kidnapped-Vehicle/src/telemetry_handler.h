@@ -0,0 +1,71 @@
+/*
+ * telemetry_handler.h
+ *
+ * Handling of the simulator's websocket messages: parses a telemetry
+ * message, runs a step of the particle filter and builds the response. Used
+ * by the uWS server and by the headless replay driver, so that both run the
+ * same code for a message.
+ */
+
+#ifndef TELEMETRY_HANDLER_H_
+#define TELEMETRY_HANDLER_H_
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+#include "particle_filter.h"
+#include "stage_timer.h"
+#include "telemetry_parser.h"
+
+class TelemetryHandler
+{
+public:
+	/*
+	 * @param pf: Particle filter run on the telemetry
+	 * @param map: Map of the landmarks, indexed for range queries
+	 * @param delta_t: Time between two telemetry messages [s]
+	 * @param sensor_range: Range of the landmark sensor [m]
+	 * @param sigma_pos[3]: GPS measurement uncertainty [x [m], y [m], theta [rad]]
+	 * @param sigma_landmark[2]: Landmark measurement uncertainty [x [m], y [m]]
+	 */
+	TelemetryHandler(ParticleFilter &pf, const Map &map, double delta_t, double sensor_range,
+									 const double sigma_pos[3], const double sigma_landmark[2]);
+
+	/*
+	 * Handles a websocket message of the simulator.
+	 * @param message: Message, read in place
+	 * @output response: Message to send back, replacing its contents. Reusing
+	 *   the buffer (e.g. one per connection) avoids allocating per message.
+	 * @output True if there is a response to send
+	 */
+	bool handleMessage(std::string_view message, std::string &response);
+
+	// Prints the weights and the number of particles after each step
+	void setVerbose(bool verbose)
+	{
+		this->verbose = verbose;
+	}
+
+	// Latency of the stages of the handled telemetry messages
+	const StageTimers &stageTimers() const
+	{
+		return stage_timers;
+	}
+
+private:
+	ParticleFilter &pf;
+	const Map &map;
+	double delta_t;
+	double sensor_range;
+	double sigma_pos[3];
+	double sigma_landmark[2];
+	bool verbose;
+
+	StageTimers stage_timers;
+	TelemetryParser parser;
+	// Contents of the current message, reused between messages
+	Telemetry telemetry;
+};
+
+#endif /* TELEMETRY_HANDLER_H_ */
@@ -0,0 +1,286 @@
+#include <string.h>
+#include <charconv>
+
+#include "telemetry_parser.h"
+
+using namespace std;
+
+// Compares a key, given by its characters between the quotes, with a name
+static bool key_is(const char *key, size_t length, const char *name)
+{
+	return strlen(name) == length && memcmp(key, name, length) == 0;
+}
+
+static bool is_whitespace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+TelemetryMessageType TelemetryParser::parse(string_view payload, Telemetry &telemetry)
+{
+	cursor = payload.data();
+	end = cursor + payload.size();
+	telemetry.fields = 0;
+
+	// A frame without an event array carries no data
+	skipWhitespace();
+	if (!consume('['))
+	{
+		return TELEMETRY_MANUAL;
+	}
+
+	skipWhitespace();
+	const char *event = cursor + 1;
+	if (cursor == end || *cursor != '"' || !skipString())
+	{
+		return TELEMETRY_INVALID;
+	}
+	bool is_telemetry = key_is(event, size_t(cursor - 1 - event), "telemetry");
+
+	skipWhitespace();
+	if (!consume(','))
+	{
+		return TELEMETRY_MANUAL;
+	}
+	skipWhitespace();
+	if (size_t(end - cursor) >= 4 && memcmp(cursor, "null", 4) == 0)
+	{
+		return TELEMETRY_MANUAL;
+	}
+	if (!is_telemetry)
+	{
+		return TELEMETRY_OTHER_EVENT;
+	}
+	return parseFields(telemetry) ? TELEMETRY_DATA : TELEMETRY_INVALID;
+}
+
+bool TelemetryParser::parseFields(Telemetry &telemetry)
+{
+	if (!consume('{'))
+	{
+		return false;
+	}
+
+	// Number of x and y values of the observations
+	size_t num_x = 0;
+	size_t num_y = 0;
+	bool parsed = true;
+	skipWhitespace();
+	if (consume('}'))
+	{
+		telemetry.observations.clear();
+		return true;
+	}
+	while (parsed)
+	{
+		skipWhitespace();
+		const char *key = cursor + 1;
+		if (cursor == end || *cursor != '"' || !skipString())
+		{
+			return false;
+		}
+		size_t key_length = size_t(cursor - 1 - key);
+		skipWhitespace();
+		if (!consume(':'))
+		{
+			return false;
+		}
+		skipWhitespace();
+
+		if (key_is(key, key_length, "sense_x"))
+		{
+			parsed = parseNumber(telemetry.sense_x);
+			telemetry.fields |= TELEMETRY_SENSE_X;
+		}
+		else if (key_is(key, key_length, "sense_y"))
+		{
+			parsed = parseNumber(telemetry.sense_y);
+			telemetry.fields |= TELEMETRY_SENSE_Y;
+		}
+		else if (key_is(key, key_length, "sense_theta"))
+		{
+			parsed = parseNumber(telemetry.sense_theta);
+			telemetry.fields |= TELEMETRY_SENSE_THETA;
+		}
+		else if (key_is(key, key_length, "previous_velocity"))
+		{
+			parsed = parseNumber(telemetry.previous_velocity);
+			telemetry.fields |= TELEMETRY_PREVIOUS_VELOCITY;
+		}
+		else if (key_is(key, key_length, "previous_yawrate"))
+		{
+			parsed = parseNumber(telemetry.previous_yawrate);
+			telemetry.fields |= TELEMETRY_PREVIOUS_YAWRATE;
+		}
+		else if (key_is(key, key_length, "sense_observations_x"))
+		{
+			parsed = parseObservations(telemetry.observations, false, num_x);
+			telemetry.fields |= TELEMETRY_OBSERVATIONS_X;
+		}
+		else if (key_is(key, key_length, "sense_observations_y"))
+		{
+			parsed = parseObservations(telemetry.observations, true, num_y);
+			telemetry.fields |= TELEMETRY_OBSERVATIONS_Y;
+		}
+		else
+		{
+			parsed = skipValue();
+		}
+
+		skipWhitespace();
+		if (consume('}'))
+		{
+			break;
+		}
+		parsed = parsed && consume(',');
+	}
+
+	// Only observations with both coordinates count; shrinking keeps the
+	// capacity for the next message
+	telemetry.observations.resize(num_x < num_y ? num_x : num_y);
+	return parsed;
+}
+
+void TelemetryParser::skipWhitespace()
+{
+	while (cursor < end && is_whitespace(*cursor))
+	{
+		cursor++;
+	}
+}
+
+bool TelemetryParser::consume(char c)
+{
+	if (cursor < end && *cursor == c)
+	{
+		cursor++;
+		return true;
+	}
+	return false;
+}
+
+bool TelemetryParser::skipString()
+{
+	for (cursor++; cursor < end; cursor++)
+	{
+		if (*cursor == '\\')
+		{
+			cursor++;
+		}
+		else if (*cursor == '"')
+		{
+			cursor++;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool TelemetryParser::skipValue()
+{
+	if (cursor == end)
+	{
+		return false;
+	}
+	if (*cursor == '"')
+	{
+		return skipString();
+	}
+	if (*cursor == '{' || *cursor == '[')
+	{
+		// Nested objects and arrays: only the brackets outside strings count
+		int depth = 0;
+		while (cursor < end)
+		{
+			char c = *cursor;
+			if (c == '"')
+			{
+				if (!skipString())
+				{
+					return false;
+				}
+				continue;
+			}
+			cursor++;
+			if (c == '{' || c == '[')
+			{
+				depth++;
+			}
+			else if ((c == '}' || c == ']') && --depth == 0)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Number or literal
+	const char *start = cursor;
+	while (cursor < end && *cursor != ',' && *cursor != '}' && *cursor != ']' && !is_whitespace(*cursor))
+	{
+		cursor++;
+	}
+	return cursor > start;
+}
+
+bool TelemetryParser::parseNumber(double &value)
+{
+	bool quoted = consume('"');
+	if (quoted)
+	{
+		skipWhitespace();
+	}
+	from_chars_result result = from_chars(cursor, end, value);
+	if (result.ec != errc() || result.ptr == cursor)
+	{
+		return false;
+	}
+	cursor = result.ptr;
+	if (quoted)
+	{
+		skipWhitespace();
+		return consume('"');
+	}
+	return true;
+}
+
+bool TelemetryParser::parseObservations(vector<LandmarkObs> &observations, bool y_coordinates,
+																				size_t &count)
+{
+	if (!consume('"'))
+	{
+		return false;
+	}
+	count = 0;
+	for (;;)
+	{
+		skipWhitespace();
+		if (consume('"'))
+		{
+			return true;
+		}
+
+		// The server has always read the observations in single precision
+		float value;
+		from_chars_result result = from_chars(cursor, end, value);
+		if (result.ec != errc() || result.ptr == cursor)
+		{
+			return false;
+		}
+		cursor = result.ptr;
+
+		if (count == observations.size())
+		{
+			observations.push_back(LandmarkObs());
+		}
+		if (y_coordinates)
+		{
+			observations[count].y = value;
+		}
+		else
+		{
+			observations[count].x = value;
+		}
+		count++;
+	}
+}
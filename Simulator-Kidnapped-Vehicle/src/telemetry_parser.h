@@ -0,0 +1,98 @@
+/*
+ * telemetry_parser.h
+ *
+ * In-place parser for the socket.io payloads of the simulator, e.g.
+ *   ["telemetry",{"sense_x":"6.27","sense_y":"1.98",...,
+ *                 "sense_observations_x":"2.1 -5.3 ","sense_observations_y":"8.4 1.0 "}]
+ * The payload is scanned once; the numbers are converted with
+ * std::from_chars where they are and the observations go straight into a
+ * reused buffer, without copying the message, building a JSON document or
+ * using streams.
+ */
+
+#ifndef TELEMETRY_PARSER_H_
+#define TELEMETRY_PARSER_H_
+
+#include <stddef.h>
+#include <string_view>
+#include <vector>
+
+#include "helper_functions.h"
+
+// Kinds of simulator messages
+enum TelemetryMessageType
+{
+	// Telemetry data for a filter step
+	TELEMETRY_DATA,
+	// Message without data, sent in manual mode
+	TELEMETRY_MANUAL,
+	// Event other than telemetry
+	TELEMETRY_OTHER_EVENT,
+	// Malformed message
+	TELEMETRY_INVALID
+};
+
+// Flags of the fields found in a telemetry message
+#define TELEMETRY_SENSE_X (1 << 0)
+#define TELEMETRY_SENSE_Y (1 << 1)
+#define TELEMETRY_SENSE_THETA (1 << 2)
+#define TELEMETRY_PREVIOUS_VELOCITY (1 << 3)
+#define TELEMETRY_PREVIOUS_YAWRATE (1 << 4)
+#define TELEMETRY_OBSERVATIONS_X (1 << 5)
+#define TELEMETRY_OBSERVATIONS_Y (1 << 6)
+
+#define TELEMETRY_SENSE_FIELDS (TELEMETRY_SENSE_X | TELEMETRY_SENSE_Y | TELEMETRY_SENSE_THETA)
+#define TELEMETRY_CONTROL_FIELDS (TELEMETRY_PREVIOUS_VELOCITY | TELEMETRY_PREVIOUS_YAWRATE)
+#define TELEMETRY_OBSERVATION_FIELDS (TELEMETRY_OBSERVATIONS_X | TELEMETRY_OBSERVATIONS_Y)
+
+// Contents of a telemetry message
+struct Telemetry
+{
+	// Noisy position [m, m, rad]
+	double sense_x;
+	double sense_y;
+	double sense_theta;
+	// Controls of the previous time step [m/s, rad/s]
+	double previous_velocity;
+	double previous_yawrate;
+	// Noisy landmark observations in vehicle coordinates; the buffer keeps
+	// its capacity between messages
+	std::vector<LandmarkObs> observations;
+	// TELEMETRY_* flags of the fields found in the message
+	unsigned fields;
+};
+
+class TelemetryParser
+{
+public:
+	TelemetryParser() : cursor(NULL), end(NULL) {}
+
+	/*
+	 * Parses the payload of a socket.io event message (the frame after its
+	 * "42" prefix). Fields other than the telemetry fields are skipped.
+	 * @param payload: Payload, read in place
+	 * @output telemetry: Fields of a TELEMETRY_DATA message; the
+	 *   observations pair the n-th x and y values
+	 * @output Kind of the message
+	 */
+	TelemetryMessageType parse(std::string_view payload, Telemetry &telemetry);
+
+private:
+	const char *cursor;
+	const char *end;
+
+	void skipWhitespace();
+	bool consume(char c);
+	// Moves past a string; cursor is at its opening quote
+	bool skipString();
+	// Moves past any JSON value
+	bool skipValue();
+	// Reads a number given as a JSON number or a string holding a number
+	bool parseNumber(double &value);
+	// Reads a string of whitespace separated numbers into the x or the y
+	// coordinates of the observations
+	bool parseObservations(std::vector<LandmarkObs> &observations, bool y_coordinates, size_t &count);
+	bool parseFields(Telemetry &telemetry);
+};
+
+#endif /* TELEMETRY_PARSER_H_ */
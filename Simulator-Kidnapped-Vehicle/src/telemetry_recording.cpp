@@ -0,0 +1,86 @@
+#include <string.h>
+
+#include "telemetry_recording.h"
+
+using namespace std;
+
+bool TelemetryRecorder::open(const string &filename)
+{
+	close();
+	file = fopen(filename.c_str(), "wb");
+	if (file == NULL)
+	{
+		return false;
+	}
+	start = chrono::steady_clock::now();
+	if (fwrite(TELEMETRY_RECORDING_MAGIC, 1, TELEMETRY_RECORDING_MAGIC_SIZE, file) != TELEMETRY_RECORDING_MAGIC_SIZE)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool TelemetryRecorder::record(string_view message)
+{
+	if (file == NULL)
+	{
+		return false;
+	}
+	uint64_t arrival_ns = uint64_t(chrono::duration_cast<chrono::nanoseconds>(
+		chrono::steady_clock::now() - start).count());
+	uint32_t message_length = uint32_t(message.size());
+
+	return fwrite(&arrival_ns, sizeof(arrival_ns), 1, file) == 1 &&
+				 fwrite(&message_length, sizeof(message_length), 1, file) == 1 &&
+				 fwrite(message.data(), 1, message.size(), file) == message.size() &&
+				 fflush(file) == 0;
+}
+
+bool TelemetryRecorder::close()
+{
+	if (file == NULL)
+	{
+		return true;
+	}
+	bool closed = fclose(file) == 0;
+	file = NULL;
+	return closed;
+}
+
+bool read_telemetry_recording(const string &filename, vector<TelemetryMessage> &messages)
+{
+	messages.clear();
+	FILE *file = fopen(filename.c_str(), "rb");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	char magic[TELEMETRY_RECORDING_MAGIC_SIZE];
+	bool complete = fread(magic, 1, sizeof(magic), file) == sizeof(magic) &&
+									memcmp(magic, TELEMETRY_RECORDING_MAGIC, sizeof(magic)) == 0;
+	while (complete)
+	{
+		TelemetryMessage message;
+		uint32_t message_length;
+		if (fread(&message.arrival_ns, sizeof(message.arrival_ns), 1, file) != 1)
+		{
+			// End of the recording
+			break;
+		}
+		complete = fread(&message_length, sizeof(message_length), 1, file) == 1;
+		if (complete)
+		{
+			message.data.resize(message_length);
+			complete = fread(&message.data[0], 1, message_length, file) == message_length;
+		}
+		if (complete)
+		{
+			messages.push_back(std::move(message));
+		}
+	}
+
+	fclose(file);
+	return complete;
+}
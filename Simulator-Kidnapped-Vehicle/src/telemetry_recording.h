@@ -0,0 +1,80 @@
+/*
+ * telemetry_recording.h
+ *
+ * Recordings of the websocket messages the simulator sends to the server,
+ * for replaying sessions without the simulator.
+ *
+ * A recording starts with an 8 byte magic ("PFTELEM1"), followed by one
+ * record per message: the arrival time [ns since the recording started] as
+ * a uint64, the message length as a uint32 and the message bytes. Numbers
+ * are in host byte order.
+ */
+
+#ifndef TELEMETRY_RECORDING_H_
+#define TELEMETRY_RECORDING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#define TELEMETRY_RECORDING_MAGIC "PFTELEM1"
+#define TELEMETRY_RECORDING_MAGIC_SIZE 8
+
+// Message of a recording
+struct TelemetryMessage
+{
+	// Arrival time [ns since the recording started]
+	uint64_t arrival_ns;
+	std::string data;
+};
+
+class TelemetryRecorder
+{
+public:
+	TelemetryRecorder() : file(NULL) {}
+
+	~TelemetryRecorder()
+	{
+		close();
+	}
+
+	/*
+	 * Starts a recording; arrival times count from now.
+	 * @param filename: Recording file, replaced if it exists
+	 * @output True if the file could be created
+	 */
+	bool open(const std::string &filename);
+
+	/*
+	 * Appends a message with the time since the recording started. Every
+	 * message is flushed, so the recording survives a killed server.
+	 * @output True if the message could be written
+	 */
+	bool record(std::string_view message);
+
+	// Ends the recording
+	bool close();
+
+	bool isOpen() const
+	{
+		return file != NULL;
+	}
+
+private:
+	FILE *file;
+	std::chrono::steady_clock::time_point start;
+};
+
+/*
+ * Reads a whole recording.
+ * @param filename: Recording file
+ * @output messages: Messages in arrival order, replacing its contents
+ * @output True if the file is a complete recording
+ */
+bool read_telemetry_recording(const std::string &filename, std::vector<TelemetryMessage> &messages);
+
+#endif /* TELEMETRY_RECORDING_H_ */